@@ -41,13 +41,24 @@
 extern "C" {
 #endif
 
-/* TLV header size*/
+/* TLV header size, also the space reserved for the ioctl header in buffers
+ * passed to mixer_ctl_get_array_in_place() and mixer_ctl_set_array_in_place() */
 #define TLV_HEADER_SIZE (2 * sizeof(unsigned int))
 
 struct mixer;
 
 struct mixer_ctl;
 
+struct mixer_transaction;
+
+struct mixer_route;
+
+struct mixer_async;
+
+struct mixer_group;
+
+struct mixer_ramp;
+
 /** Mixer control type.
  * @ingroup libtinyalsa-mixer
  */
@@ -68,14 +79,85 @@ enum mixer_ctl_type {
     MIXER_CTL_TYPE_MAX,
 };
 
+/** The value of the control changed.
+ * Used in @ref mixer_ctl_event.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_EVENT_VALUE 0x01
+
+/** The info of the control (i.e. range, number of values) changed.
+ * Used in @ref mixer_ctl_event.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_EVENT_INFO 0x02
+
+/** The control was added.
+ * Used in @ref mixer_ctl_event.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_EVENT_ADD 0x04
+
+/** The TLV data of the control changed.
+ * Used in @ref mixer_ctl_event.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_EVENT_TLV 0x08
+
+/** The control was removed.
+ * When set, no other flag is set.
+ * Used in @ref mixer_ctl_event.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_EVENT_REMOVE 0x10
+
+/** The gain of a muted control, in 1/100 dB.
+ * Used by @ref mixer_ctl_get_db and @ref mixer_ctl_set_db.
+ * @ingroup libtinyalsa-mixer
+ */
+#define MIXER_CTL_DB_MUTE (-9999999)
+
+/** A decoded mixer control event.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ctl_event {
+    /** A bitwise OR of the MIXER_CTL_EVENT_ flags */
+    unsigned int mask;
+    /** The id of the control, as returned by @ref mixer_ctl_get_id */
+    unsigned int id;
+    /** The control the event refers to.
+     * This is NULL if the control is not known to the mixer,
+     * which is the case for controls added after @ref mixer_open
+     * and not yet picked up by @ref mixer_add_new_ctls */
+    struct mixer_ctl *ctl;
+};
+
+/** The value of an IEC958 (S/PDIF, HDMI) control.
+ * The layout matches struct snd_aes_iec958 of the kernel.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_iec958 {
+    /** The channel status bits */
+    unsigned char status[24];
+    /** The subcode bits */
+    unsigned char subcode[147];
+    /** Unused */
+    unsigned char pad;
+    /** The subframe bits */
+    unsigned char dig_subframe[4];
+};
+
 struct mixer *mixer_open(unsigned int card);
 
 void mixer_close(struct mixer *mixer);
 
 int mixer_add_new_ctls(struct mixer *mixer);
 
+int mixer_enable_thread_safety(struct mixer *mixer);
+
 const char *mixer_get_name(const struct mixer *mixer);
 
+int mixer_get_file_descriptor(const struct mixer *mixer);
+
 unsigned int mixer_get_num_ctls(const struct mixer *mixer);
 
 unsigned int mixer_get_num_ctls_by_name(const struct mixer *mixer, const char *name);
@@ -90,10 +172,21 @@ struct mixer_ctl *mixer_get_ctl_by_name_and_index(struct mixer *mixer,
                                                   const char *name,
                                                   unsigned int index);
 
+/* Find the controls whose name matches a shell wildcard pattern */
+typedef int (*mixer_ctl_callback)(struct mixer_ctl *ctl, void *data);
+
+int mixer_find_ctls(struct mixer *mixer, const char *pattern,
+                    mixer_ctl_callback callback, void *data);
+
 int mixer_subscribe_events(struct mixer *mixer, int subscribe);
 
 int mixer_wait_event(struct mixer *mixer, int timeout);
 
+int mixer_read_event(struct mixer *mixer, struct mixer_ctl_event *events,
+                     unsigned int count);
+
+int mixer_consume_event(struct mixer *mixer);
+
 unsigned int mixer_ctl_get_id(const struct mixer_ctl *ctl);
 
 const char *mixer_ctl_get_name(const struct mixer_ctl *ctl);
@@ -121,16 +214,155 @@ int mixer_ctl_get_percent(const struct mixer_ctl *ctl, unsigned int id);
 
 int mixer_ctl_set_percent(struct mixer_ctl *ctl, unsigned int id, int percent);
 
+int mixer_ctl_set_percent_array(struct mixer_ctl *ctl, const int *percent,
+                                unsigned int count);
+
 int mixer_ctl_get_value(const struct mixer_ctl *ctl, unsigned int id);
 
+int mixer_ctl_get_values(const struct mixer_ctl *ctl, int *values,
+                         unsigned int count);
+
 int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count);
 
 int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value);
 
+int mixer_ctl_set_values(struct mixer_ctl *ctl, const int *values,
+                         unsigned int count);
+
 int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count);
 
 int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string);
 
+/* Access 64 bit integer and IEC958 controls */
+int mixer_ctl_get_value64(const struct mixer_ctl *ctl, unsigned int id,
+                          long long *value);
+
+int mixer_ctl_set_value64(struct mixer_ctl *ctl, unsigned int id,
+                          long long value);
+
+int mixer_ctl_get_iec958(const struct mixer_ctl *ctl,
+                         struct mixer_iec958 *iec958);
+
+int mixer_ctl_set_iec958(struct mixer_ctl *ctl,
+                         const struct mixer_iec958 *iec958);
+
+/* Access TLV byte controls without allocating or copying */
+int mixer_ctl_get_array_in_place(const struct mixer_ctl *ctl, void *buffer,
+                                 size_t count);
+
+int mixer_ctl_set_array_in_place(struct mixer_ctl *ctl, void *buffer,
+                                 size_t count);
+
+int mixer_ctl_set_array_chunked(struct mixer_ctl *ctl, void *buffer,
+                                size_t count, size_t chunk_size);
+
+/* Stage many control values and write them together */
+struct mixer_transaction *mixer_transaction_begin(struct mixer *mixer);
+
+void mixer_transaction_free(struct mixer_transaction *transaction);
+
+int mixer_transaction_set_value(struct mixer_transaction *transaction,
+                                struct mixer_ctl *ctl, unsigned int id,
+                                int value);
+
+int mixer_transaction_commit(struct mixer_transaction *transaction);
+
+unsigned int mixer_transaction_get_ioctls_saved(const struct mixer_transaction *transaction);
+
+/* Load named sets of control values (paths) and switch between them */
+struct mixer_route *mixer_route_open(struct mixer *mixer, const char *filename);
+
+void mixer_route_close(struct mixer_route *route);
+
+int mixer_route_apply_path(struct mixer_route *route, const char *name);
+
+int mixer_route_reset_path(struct mixer_route *route, const char *name);
+
+int mixer_route_switch_path(struct mixer_route *route, const char *from,
+                            const char *to);
+
+/* Queue control writes from threads that must not block */
+struct mixer_async *mixer_async_open(struct mixer *mixer,
+                                     unsigned int queue_size,
+                                     size_t max_array_size);
+
+void mixer_async_close(struct mixer_async *async);
+
+int mixer_async_set_value(struct mixer_async *async, struct mixer_ctl *ctl,
+                          unsigned int id, int value);
+
+int mixer_async_set_array(struct mixer_async *async, struct mixer_ctl *ctl,
+                          const void *array, size_t count);
+
+int mixer_async_get_fd(const struct mixer_async *async);
+
+unsigned int mixer_async_get_completed(const struct mixer_async *async);
+
+unsigned int mixer_async_get_failed(const struct mixer_async *async,
+                                    int *last_error);
+
+/* Open the mixers of all cards and dispatch their events from one thread */
+typedef void (*mixer_group_callback)(struct mixer_group *group,
+                                     struct mixer *mixer,
+                                     const struct mixer_ctl_event *event,
+                                     void *data);
+
+struct mixer_group *mixer_group_open(void);
+
+void mixer_group_close(struct mixer_group *group);
+
+unsigned int mixer_group_get_num_mixers(const struct mixer_group *group);
+
+struct mixer *mixer_group_get_mixer(struct mixer_group *group,
+                                    unsigned int card);
+
+struct mixer_ctl *mixer_group_get_ctl(struct mixer_group *group,
+                                      unsigned int card, const char *name,
+                                      unsigned int index);
+
+int mixer_group_set_callback(struct mixer_group *group, struct mixer_ctl *ctl,
+                             mixer_group_callback callback, void *data);
+
+int mixer_group_get_fd(const struct mixer_group *group);
+
+int mixer_group_dispatch(struct mixer_group *group, int timeout);
+
+int mixer_group_get_error(const struct mixer_group *group, unsigned int card);
+
+/* Save the values of all controls and restore them */
+int mixer_state_save(struct mixer *mixer, const char *filename);
+
+int mixer_state_restore(struct mixer *mixer, const char *filename);
+
+int mixer_state_export(struct mixer *mixer, const char *filename);
+
+/* Get and set the gain of volume controls in 1/100 dB */
+int mixer_ctl_get_db(struct mixer_ctl *ctl, unsigned int id, int *centibel);
+
+int mixer_ctl_set_db(struct mixer_ctl *ctl, int centibel);
+
+int mixer_ctl_ramp_db(struct mixer_ctl *ctl, int centibel,
+                      unsigned int duration_ms);
+
+int mixer_ctl_db_to_value(struct mixer_ctl *ctl, int centibel);
+
+int mixer_ctl_value_to_db(struct mixer_ctl *ctl, int value, int *centibel);
+
+/* Ramp controls to new values in the background */
+struct mixer_ramp *mixer_ramp_open(unsigned int step_ms);
+
+void mixer_ramp_close(struct mixer_ramp *ramp);
+
+int mixer_ramp_set_value(struct mixer_ramp *ramp, struct mixer_ctl *ctl,
+                         int value, unsigned int duration_ms);
+
+int mixer_ramp_set_db(struct mixer_ramp *ramp, struct mixer_ctl *ctl,
+                      int centibel, unsigned int duration_ms);
+
+int mixer_ramp_cancel(struct mixer_ramp *ramp, struct mixer_ctl *ctl);
+
+unsigned int mixer_ramp_get_num_active(struct mixer_ramp *ramp);
+
 /* Determe range of integer mixer controls */
 int mixer_ctl_get_range_min(const struct mixer_ctl *ctl);
 
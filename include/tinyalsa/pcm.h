@@ -278,12 +278,16 @@ unsigned int pcm_format_to_bits(enum pcm_format format);
 
 unsigned int pcm_get_buffer_size(const struct pcm *pcm);
 
+unsigned int pcm_get_xruns(const struct pcm *pcm);
+
 unsigned int pcm_frames_to_bytes(const struct pcm *pcm, unsigned int frames);
 
 unsigned int pcm_bytes_to_frames(const struct pcm *pcm, unsigned int bytes);
 
 int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail, struct timespec *tstamp);
 
+int pcm_get_trigger_timestamp(struct pcm *pcm, struct timespec *tstamp);
+
 unsigned int pcm_get_subdevice(const struct pcm *pcm);
 
 int pcm_writei(struct pcm *pcm, const void *data, unsigned int frame_count) TINYALSA_WARN_UNUSED_RESULT;
@@ -302,6 +306,10 @@ int pcm_mmap_begin(struct pcm *pcm, void **areas, unsigned int *offset, unsigned
 
 int pcm_mmap_commit(struct pcm *pcm, unsigned int offset, unsigned int frames);
 
+int pcm_avail_update(struct pcm *pcm);
+
+int pcm_state(struct pcm *pcm);
+
 int pcm_link(struct pcm *pcm1, struct pcm *pcm2);
 
 int pcm_unlink(struct pcm *pcm);
@@ -34,9 +34,12 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fnmatch.h>
 #include <limits.h>
 #include <time.h>
 #include <poll.h>
+#include <math.h>
+#include <pthread.h>
 
 #include <sys/ioctl.h>
 
@@ -58,16 +61,174 @@
 
 #include <tinyalsa/mixer.h>
 
+#include "mixer_internal.h"
+
+/* TLV types, from sound/tlv.h which older kernel headers do not have */
+#ifndef SNDRV_CTL_TLVT_CONTAINER
+#define SNDRV_CTL_TLVT_CONTAINER 0
+#define SNDRV_CTL_TLVT_DB_SCALE 1
+#define SNDRV_CTL_TLVT_DB_LINEAR 2
+#define SNDRV_CTL_TLVT_DB_RANGE 3
+#define SNDRV_CTL_TLVT_DB_MINMAX 4
+#define SNDRV_CTL_TLVT_DB_MINMAX_MUTE 5
+#endif
+
+/* the largest TLV that is read to build a dB table, in words */
+#define MIXER_DB_TLV_WORDS 256
+
+/* the largest range of raw values that a dB table is built for */
+#define MIXER_DB_TABLE_MAX 65536
+
+/** The dB value of each raw value of an integer control,
+ * built from the control's TLV data on first use.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ctl_db {
+    /** The raw value of the first entry */
+    int min;
+    /** The number of entries */
+    unsigned int count;
+    /** The gain in 1/100 dB of each raw value, or @ref MIXER_CTL_DB_MUTE.
+     * The gains are in ascending order */
+    int centibel[];
+};
+
+/** The names of the items of an enumerated control.
+ * The count is kept with the names, since the control's own count may
+ * change under a reader when the control is updated.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_enames {
+    /** The number of names */
+    unsigned int items;
+    /** The names, in item order */
+    char *names[];
+};
+
+/** The info of a control that may change when the control is updated.
+ * It is never modified in place once the control is published: the update
+ * replaces it as a whole, so readers that load it once see one consistent
+ * set of values.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ctl_info {
+    /** The access flags of the control (i.e. read, write, TLV) */
+    unsigned int access;
+    /** The number of values in the control */
+    unsigned int count;
+    /** The type of the control's values */
+    int type;
+    /** The range of the values (integer controls) or the number of items
+     * (enumerated controls). The rest of the control's info is not kept,
+     * it is read from the driver on demand */
+    union {
+        struct {
+            int min;
+            int max;
+        } integer;
+        unsigned int items;
+    } value;
+};
+
 /** A mixer control.
  * @ingroup libtinyalsa-mixer
  */
 struct mixer_ctl {
     /** The mixer that the mixer control belongs to */
     struct mixer *mixer;
-    /** Information on the control's value (i.e. type, number of values) */
-    struct snd_ctl_elem_info info;
     /** A list of string representations of enumerated values (only valid for enumerated controls) */
-    char **ename;
+    struct mixer_enames *ename;
+    /** The dB table (only valid for integer controls with dB TLV data) */
+    struct mixer_ctl_db *db;
+    /** The name of the control, stored in one of the mixer's name chunks */
+    const char *name;
+    /** The numeric id that the driver assigned to the control */
+    unsigned int numid;
+    /** The current info, @ref base or a copy made by @ref mixer_ctl_update */
+    struct mixer_ctl_info *info;
+    /** The info read when the control was added */
+    struct mixer_ctl_info base;
+};
+
+/* Controls are stored in segments that are never moved, so that control
+ * handles stay valid when controls are added. Segment k holds
+ * MIXER_CTL_SEGMENT_BASE << k controls, so a fixed number of segments
+ * covers every possible control id.
+ */
+#define MIXER_CTL_SEGMENT_SHIFT 5
+#define MIXER_CTL_SEGMENT_BASE (1u << MIXER_CTL_SEGMENT_SHIFT)
+#define MIXER_CTL_SEGMENTS (32 - MIXER_CTL_SEGMENT_SHIFT)
+
+/** A chunk of control names, each one terminated by a null character.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_names {
+    /** The chunk allocated before this one */
+    struct mixer_names *next;
+    /** The names */
+    char data[];
+};
+
+/** Enumerated item names, a dB table and control info that were replaced
+ * while the mixer was shared between threads. They are freed when the mixer
+ * is closed, because readers may still be using them.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_retired {
+    /** The entry retired before this one */
+    struct mixer_retired *next;
+    /** The names */
+    struct mixer_enames *ename;
+    /** The dB table */
+    struct mixer_ctl_db *db;
+    /** The control info */
+    struct mixer_ctl_info *info;
+};
+
+/** An entry of the control name index.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_name_entry {
+    /** The hash of the control's name */
+    unsigned int hash;
+    /** The control id plus one, zero for an empty entry */
+    unsigned int id;
+};
+
+/** An open addressed hash index of control names.
+ * Controls with the same name share a probe sequence and are inserted in id
+ * order, so they are found in the order that mixer_get_ctl_by_name_and_index()
+ * counts them.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_name_index {
+    /** The index that was replaced by this one */
+    struct mixer_name_index *next;
+    /** The number of entries minus one */
+    unsigned int mask;
+    /** The entries */
+    struct mixer_name_entry entries[];
+};
+
+/** A node of the control name trie.
+ * Edges are labelled with parts of the control names, which live as long as
+ * the mixer, and the children of a node are sorted by the first character
+ * of their label.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_trie_node {
+    /** The first child */
+    struct mixer_trie_node *child;
+    /** The next sibling */
+    struct mixer_trie_node *sibling;
+    /** The label of the edge to this node, not null terminated */
+    const char *label;
+    /** The length of the label */
+    unsigned int length;
+    /** The number of controls whose name ends at this node */
+    unsigned int num_ids;
+    /** The ids of these controls, in ascending order */
+    unsigned int *ids;
 };
 
 /** A mixer handle.
@@ -78,24 +239,99 @@ struct mixer {
     int fd;
     /** Card information */
     struct snd_ctl_card_info card_info;
-    /** A continuous array of mixer controls */
-    struct mixer_ctl *ctl;
+    /** The segments of mixer controls */
+    struct mixer_ctl *ctl[MIXER_CTL_SEGMENTS];
     /** The number of mixer controls */
     unsigned int count;
+    /** The names of all controls, one chunk per call to add_controls() */
+    struct mixer_names *names;
+    /** The name index, replaced indexes are kept in its list until close */
+    struct mixer_name_index *index;
+    /** The number of controls in @ref index, the rest are scanned */
+    unsigned int indexed;
+    /** The root of the name trie, used by @ref mixer_find_ctls */
+    struct mixer_trie_node *trie;
+    /** The number of controls in @ref trie, the rest are scanned */
+    unsigned int trie_count;
+    /** Set by @ref mixer_enable_thread_safety */
+    int thread_safe;
+    /** Serializes writers, if @ref thread_safe is set */
+    pthread_mutex_t lock;
+    /** Item names that readers may still use, if @ref thread_safe is set */
+    struct mixer_retired *retired;
 };
 
-static void mixer_cleanup_control(struct mixer_ctl *ctl)
+/* The number of controls is published with release semantics once the new
+ * controls are fully initialized, so a reader that sees a control id below
+ * the count also sees the control.
+ */
+static unsigned int mixer_count(const struct mixer *mixer)
+{
+    return __atomic_load_n(&mixer->count, __ATOMIC_ACQUIRE);
+}
+
+static void mixer_lock(struct mixer *mixer)
+{
+    if (mixer->thread_safe)
+        pthread_mutex_lock(&mixer->lock);
+}
+
+static void mixer_unlock(struct mixer *mixer)
+{
+    if (mixer->thread_safe)
+        pthread_mutex_unlock(&mixer->lock);
+}
+
+static unsigned int mixer_ctl_segment(unsigned int id, unsigned int *offset)
+{
+    unsigned int v = id + MIXER_CTL_SEGMENT_BASE;
+    unsigned int k = (31 - __builtin_clz(v)) - MIXER_CTL_SEGMENT_SHIFT;
+
+    *offset = v - (MIXER_CTL_SEGMENT_BASE << k);
+    return k;
+}
+
+static struct mixer_ctl *mixer_ctl_at(const struct mixer *mixer,
+                                      unsigned int id)
+{
+    unsigned int offset;
+    unsigned int k = mixer_ctl_segment(id, &offset);
+
+    return mixer->ctl[k] + offset;
+}
+
+static void mixer_trie_free(struct mixer_trie_node *node)
+{
+    struct mixer_trie_node *next;
+
+    while (node) {
+        next = node->sibling;
+        mixer_trie_free(node->child);
+        free(node->ids);
+        free(node);
+        node = next;
+    }
+}
+
+static void mixer_free_enames(struct mixer_enames *ename)
 {
     unsigned int m;
 
-    if (ctl->ename) {
-        unsigned int max = ctl->info.value.enumerated.items;
-        for (m = 0; m < max; m++)
-            free(ctl->ename[m]);
-        free(ctl->ename);
+    if (ename) {
+        for (m = 0; m < ename->items; m++)
+            free(ename->names[m]);
+        free(ename);
     }
 }
 
+static void mixer_cleanup_control(struct mixer_ctl *ctl)
+{
+    mixer_free_enames(ctl->ename);
+    free(ctl->db);
+    if (ctl->info != &ctl->base)
+        free(ctl->info);
+}
+
 /** Closes a mixer returned by @ref mixer_open.
  * @param mixer A mixer handle.
  * @ingroup libtinyalsa-mixer
@@ -110,12 +346,38 @@ void mixer_close(struct mixer *mixer)
     if (mixer->fd >= 0)
         close(mixer->fd);
 
-    if (mixer->ctl) {
-        for (n = 0; n < mixer->count; n++)
-            mixer_cleanup_control(&mixer->ctl[n]);
-        free(mixer->ctl);
+    for (n = 0; n < mixer->count; n++)
+        mixer_cleanup_control(mixer_ctl_at(mixer, n));
+
+    for (n = 0; n < MIXER_CTL_SEGMENTS; n++)
+        free(mixer->ctl[n]);
+
+    while (mixer->names) {
+        struct mixer_names *names = mixer->names;
+        mixer->names = names->next;
+        free(names);
     }
 
+    while (mixer->index) {
+        struct mixer_name_index *index = mixer->index;
+        mixer->index = index->next;
+        free(index);
+    }
+
+    mixer_trie_free(mixer->trie);
+
+    while (mixer->retired) {
+        struct mixer_retired *retired = mixer->retired;
+        mixer->retired = retired->next;
+        mixer_free_enames(retired->ename);
+        free(retired->db);
+        free(retired->info);
+        free(retired);
+    }
+
+    if (mixer->thread_safe)
+        pthread_mutex_destroy(&mixer->lock);
+
     free(mixer);
 
     /* TODO: verify frees */
@@ -133,6 +395,235 @@ static void *mixer_realloc_z(void *ptr, size_t curnum, size_t newnum, size_t siz
         return newp;
 }
 
+/* Allocates the segments needed to hold count controls.
+ * Segments that exist already are left in place.
+ */
+static int mixer_alloc_segments(struct mixer *mixer, unsigned int count)
+{
+    unsigned int offset;
+    unsigned int last;
+    unsigned int k;
+
+    if (!count)
+        return 0;
+
+    last = mixer_ctl_segment(count - 1, &offset);
+    for (k = 0; k <= last; k++) {
+        if (mixer->ctl[k])
+            continue;
+        mixer->ctl[k] = calloc(MIXER_CTL_SEGMENT_BASE << k,
+                               sizeof(struct mixer_ctl));
+        if (!mixer->ctl[k])
+            return -1;
+    }
+
+    return 0;
+}
+
+static void mixer_ctl_set_info(struct mixer_ctl_info *info,
+                               const struct snd_ctl_elem_info *ei)
+{
+    memset(info, 0, sizeof(*info));
+    info->access = ei->access;
+    info->count = ei->count;
+    info->type = ei->type;
+
+    switch (ei->type) {
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+        info->value.integer.min = ei->value.integer.min;
+        info->value.integer.max = ei->value.integer.max;
+        break;
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        info->value.items = ei->value.enumerated.items;
+        break;
+    }
+}
+
+/* Gets the current info of a control. Callers load it once and use that
+ * copy, which stays valid while the mixer is open.
+ */
+static const struct mixer_ctl_info *mixer_ctl_info(const struct mixer_ctl *ctl)
+{
+    return __atomic_load_n(&ctl->info, __ATOMIC_ACQUIRE);
+}
+
+/* Stores the names of the controls in eid in a new chunk, starting at the
+ * control with id first. Names are stored back to back, so a control costs
+ * the length of its name instead of the fixed size buffer of
+ * struct snd_ctl_elem_id. Chunks are never reallocated, so names returned
+ * by mixer_ctl_get_name() stay valid while the mixer is open.
+ */
+static int mixer_add_names(struct mixer *mixer, unsigned int first,
+                           const struct snd_ctl_elem_id *eid,
+                           unsigned int count)
+{
+    struct mixer_names *names;
+    size_t size = 0;
+    size_t pos = 0;
+    unsigned int n;
+    size_t len;
+
+    for (n = 0; n < count; n++)
+        size += strnlen((const char *)eid[n].name, sizeof(eid[n].name)) + 1;
+
+    names = malloc(sizeof(*names) + size);
+    if (!names)
+        return -1;
+    names->next = mixer->names;
+    mixer->names = names;
+
+    for (n = 0; n < count; n++) {
+        len = strnlen((const char *)eid[n].name, sizeof(eid[n].name));
+        memcpy(names->data + pos, eid[n].name, len);
+        names->data[pos + len] = '\0';
+        mixer_ctl_at(mixer, first + n)->name = names->data + pos;
+        pos += len + 1;
+    }
+
+    return 0;
+}
+
+static unsigned int mixer_name_hash(const char *name)
+{
+    /* FNV-1a */
+    unsigned int hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void mixer_name_index_insert(const struct mixer *mixer,
+                                    struct mixer_name_index *index,
+                                    unsigned int id)
+{
+    unsigned int hash = mixer_name_hash(mixer_ctl_at(mixer, id)->name);
+    unsigned int pos = hash & index->mask;
+
+    while (index->entries[pos].id)
+        pos = (pos + 1) & index->mask;
+
+    /* readers check the id first, so it is stored last */
+    index->entries[pos].hash = hash;
+    __atomic_store_n(&index->entries[pos].id, id + 1, __ATOMIC_RELEASE);
+}
+
+/* Adds the controls from mixer->indexed up to count to the name index.
+ * When the index would become more than half full, a larger one is built
+ * and published, and the old one is kept for readers until the mixer is
+ * closed. On allocation failure the index is left as it is, and lookups
+ * scan the controls that are not indexed.
+ */
+static void mixer_name_index_update(struct mixer *mixer, unsigned int count)
+{
+    struct mixer_name_index *index = mixer->index;
+    unsigned int size = 64;
+    unsigned int n;
+
+    if (!index || (count * 2 > index->mask + 1)) {
+        while (size < count * 2)
+            size <<= 1;
+        index = calloc(1, sizeof(*index) + size * sizeof(index->entries[0]));
+        if (!index)
+            return;
+        index->mask = size - 1;
+        for (n = 0; n < mixer->indexed; n++)
+            mixer_name_index_insert(mixer, index, n);
+        index->next = mixer->index;
+        __atomic_store_n(&mixer->index, index, __ATOMIC_RELEASE);
+    }
+
+    for (n = mixer->indexed; n < count; n++)
+        mixer_name_index_insert(mixer, index, n);
+    __atomic_store_n(&mixer->indexed, count, __ATOMIC_RELEASE);
+}
+
+/* Inserts a control in the trie. On allocation failure, the control is not
+ * inserted, but the trie stays valid.
+ */
+static int mixer_trie_insert(struct mixer *mixer, unsigned int id)
+{
+    struct mixer_trie_node *node = mixer->trie;
+    struct mixer_trie_node **link;
+    struct mixer_trie_node *child;
+    struct mixer_trie_node *split;
+    const char *name = mixer_ctl_at(mixer, id)->name;
+    unsigned int *ids;
+    unsigned int common;
+
+    while (*name) {
+        /* children are sorted by the first character of their label */
+        for (link = &node->child; *link; link = &(*link)->sibling)
+            if ((unsigned char) (*link)->label[0] >= (unsigned char) *name)
+                break;
+        child = *link;
+
+        if (!child || child->label[0] != *name) {
+            child = calloc(1, sizeof(*child));
+            if (!child)
+                return -1;
+            child->label = name;
+            child->length = strlen(name);
+            child->sibling = *link;
+            *link = child;
+        }
+
+        for (common = 1; common < child->length; common++)
+            if (child->label[common] != name[common])
+                break;
+
+        if (common < child->length) {
+            /* the name leaves the label part way, split the edge */
+            split = calloc(1, sizeof(*split));
+            if (!split)
+                return -1;
+            split->label = child->label;
+            split->length = common;
+            split->sibling = child->sibling;
+            split->child = child;
+            child->label += common;
+            child->length -= common;
+            child->sibling = NULL;
+            *link = split;
+            child = split;
+        }
+
+        node = child;
+        name += common;
+    }
+
+    ids = realloc(node->ids, (node->num_ids + 1) * sizeof(*ids));
+    if (!ids)
+        return -1;
+    ids[node->num_ids++] = id;
+    node->ids = ids;
+    return 0;
+}
+
+/* Adds the controls from mixer->trie_count up to count to the name trie.
+ * On allocation failure, the remaining controls are left out, and queries
+ * scan them instead.
+ */
+static void mixer_trie_update(struct mixer *mixer, unsigned int count)
+{
+    unsigned int n;
+
+    if (!mixer->trie) {
+        mixer->trie = calloc(1, sizeof(*mixer->trie));
+        if (!mixer->trie)
+            return;
+        mixer->trie->label = "";
+    }
+
+    for (n = mixer->trie_count; n < count; n++)
+        if (mixer_trie_insert(mixer, n) < 0)
+            break;
+    mixer->trie_count = n;
+}
+
 static int add_controls(struct mixer *mixer)
 {
     struct snd_ctl_elem_list elist;
@@ -153,13 +644,9 @@ static int add_controls(struct mixer *mixer)
     if (old_count > elist.count)
         return -1; /* driver has removed controls - this is bad */
 
-    ctl = mixer_realloc_z(mixer->ctl, old_count, elist.count,
-                          sizeof(struct mixer_ctl));
-    if (!ctl)
+    if (mixer_alloc_segments(mixer, elist.count) < 0)
         goto fail;
 
-    mixer->ctl = ctl;
-
     /* ALSA drivers are not supposed to remove or re-order controls that
      * have already been created so we know that any new controls must
      * be after the ones we have already collected
@@ -177,26 +664,39 @@ static int add_controls(struct mixer *mixer)
     if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_LIST, &elist) < 0)
         goto fail;
 
+    if (mixer_add_names(mixer, old_count, eid, elist.space) < 0)
+        goto fail;
+
     for (n = old_count; n < new_count; n++) {
-        struct snd_ctl_elem_info *ei = &mixer->ctl[n].info;
-        ei->id.numid = eid[n - old_count].numid;
-        if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, ei) < 0)
+        struct snd_ctl_elem_info ei;
+        ctl = mixer_ctl_at(mixer, n);
+        memset(&ei, 0, sizeof(ei));
+        ei.id.numid = eid[n - old_count].numid;
+        if (ioctl(fd, SNDRV_CTL_IOCTL_ELEM_INFO, &ei) < 0)
             goto fail_extend;
-        ctl[n].mixer = mixer;
+        ctl->numid = ei.id.numid;
+        mixer_ctl_set_info(&ctl->base, &ei);
+        ctl->info = &ctl->base;
+        ctl->mixer = mixer;
     }
 
-    mixer->count = new_count;
+    mixer_name_index_update(mixer, new_count);
+    mixer_trie_update(mixer, new_count);
+    __atomic_store_n(&mixer->count, new_count, __ATOMIC_RELEASE);
     free(eid);
     return 0;
 
 fail_extend:
     /* cleanup the control we failed on but leave the ones that were already
-     * added. Also no advantage to shrinking the resized memory block, we
-     * might want to extend the controls again later
+     * added. The segments are kept, we might want to extend the controls
+     * again later
      */
-    mixer_cleanup_control(&ctl[n]);
+    mixer_cleanup_control(ctl);
 
-    mixer->count = n;   /* keep controls we successfully added */
+    /* keep controls we successfully added */
+    mixer_name_index_update(mixer, n);
+    mixer_trie_update(mixer, n);
+    __atomic_store_n(&mixer->count, n, __ATOMIC_RELEASE);
     /* fall through... */
 fail:
     free(eid);
@@ -249,21 +749,58 @@ fail:
  * the new controls is much faster than calling mixer_close() then mixer_open()
  * to re-scan all controls.
  *
- * NOTE: this invalidates any struct mixer_ctl pointers previously obtained
- * from mixer_get_ctl() and mixer_get_ctl_by_name(). Either refresh all your
- * stored pointers after calling mixer_update_ctls(), or (better) do not
- * store struct mixer_ctl pointers, instead lookup the control by name or
- * id only when you are about to use it. The overhead of lookup by id
- * using mixer_get_ctl() is negligible.
+ * Existing controls are not moved, so struct mixer_ctl pointers previously
+ * obtained from mixer_get_ctl() and mixer_get_ctl_by_name(), as well as
+ * names returned by mixer_ctl_get_name(), remain valid and can be cached
+ * until mixer_close() is called.
  * @param mixer An initialized mixer handle.
  * @returns 0 on success, -1 on failure
  */
 int mixer_add_new_ctls(struct mixer *mixer)
+{
+    int ret;
+
+    if (!mixer)
+        return 0;
+
+    mixer_lock(mixer);
+    ret = add_controls(mixer);
+    mixer_unlock(mixer);
+    return ret;
+}
+
+/** Makes a mixer safe to share between threads.
+ * Lookups and reads stay lock free: controls never move (see
+ * @ref mixer_add_new_ctls), new controls are published atomically, and
+ * enumerated item names are filled in lock free. @ref mixer_ctl_update
+ * replaces a control's info (type, number of values, range), item names and
+ * dB table each as a whole, so a reader sees either the old or the new
+ * ones, and the old ones are not freed before the mixer is closed.
+ * Control values are not cached, every read goes to the driver.
+ * Functions that change the control set or the control info, or that read
+ * and then write back a control's values
+ * (@ref mixer_ctl_set_value, @ref mixer_ctl_set_values,
+ * @ref mixer_transaction_commit, @ref mixer_ctl_set_array_chunked),
+ * serialize on a lock.
+ * This must be called before the mixer is shared.
+ * @param mixer An initialized mixer handle.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_enable_thread_safety(struct mixer *mixer)
 {
     if (!mixer)
+        return -EINVAL;
+
+    if (mixer->thread_safe)
         return 0;
 
-    return add_controls(mixer);
+    if (pthread_mutex_init(&mixer->lock, NULL) != 0)
+        return -1;
+
+    mixer->thread_safe = 1;
+    return 0;
 }
 
 /** Gets the name of the mixer's card.
@@ -276,6 +813,17 @@ const char *mixer_get_name(const struct mixer *mixer)
     return (const char *)mixer->card_info.name;
 }
 
+/** Gets the file descriptor of the mixer's control device.
+ * Useful for waiting on events of several mixers at once.
+ * @param mixer An initialized mixer handle.
+ * @returns The file descriptor of the mixer.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_get_file_descriptor(const struct mixer *mixer)
+{
+    return mixer->fd;
+}
+
 /** Gets the number of mixer controls for a given mixer.
  * @param mixer An initialized mixer handle.
  * @returns The number of mixer controls for the given mixer.
@@ -286,7 +834,7 @@ unsigned int mixer_get_num_ctls(const struct mixer *mixer)
     if (!mixer)
         return 0;
 
-    return mixer->count;
+    return mixer_count(mixer);
 }
 
 /** Gets the number of mixer controls, that go by a specified name, for a given mixer.
@@ -299,15 +847,14 @@ unsigned int mixer_get_num_ctls_by_name(const struct mixer *mixer, const char *n
 {
     unsigned int n;
     unsigned int count = 0;
-    struct mixer_ctl *ctl;
+    unsigned int num_ctls;
 
     if (!mixer)
         return 0;
 
-    ctl = mixer->ctl;
-
-    for (n = 0; n < mixer->count; n++)
-        if (!strcmp(name, (char*) ctl[n].info.id.name))
+    num_ctls = mixer_count(mixer);
+    for (n = 0; n < num_ctls; n++)
+        if (!strcmp(name, mixer_ctl_at(mixer, n)->name))
             count++;
 
     return count;
@@ -357,6 +904,143 @@ int mixer_wait_event(struct mixer *mixer, int timeout)
     }
 }
 
+/* Looks up a control by the numid the driver assigned to it. Drivers hand out
+ * numids in ascending order starting at one, so the control is almost always
+ * found at index numid - 1. If the numid space has holes, fall back to a
+ * binary search, which relies on the element list being sorted by numid.
+ */
+static struct mixer_ctl *mixer_get_ctl_by_numid(struct mixer *mixer,
+                                                unsigned int numid)
+{
+    struct mixer_ctl *ctl;
+    unsigned int count = mixer_count(mixer);
+    unsigned int lo, hi, mid;
+
+    if ((numid > 0) && (numid <= count)) {
+        ctl = mixer_ctl_at(mixer, numid - 1);
+        if (ctl->numid == numid)
+            return ctl;
+    }
+
+    lo = 0;
+    hi = count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        ctl = mixer_ctl_at(mixer, mid);
+        if (ctl->numid == numid)
+            return ctl;
+        if (ctl->numid < numid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+static unsigned int mixer_event_mask_from_alsa(unsigned int mask)
+{
+    unsigned int event_mask = 0;
+
+    if (mask == SNDRV_CTL_EVENT_MASK_REMOVE)
+        return MIXER_CTL_EVENT_REMOVE;
+
+    if (mask & SNDRV_CTL_EVENT_MASK_VALUE)
+        event_mask |= MIXER_CTL_EVENT_VALUE;
+    if (mask & SNDRV_CTL_EVENT_MASK_INFO)
+        event_mask |= MIXER_CTL_EVENT_INFO;
+    if (mask & SNDRV_CTL_EVENT_MASK_ADD)
+        event_mask |= MIXER_CTL_EVENT_ADD;
+    if (mask & SNDRV_CTL_EVENT_MASK_TLV)
+        event_mask |= MIXER_CTL_EVENT_TLV;
+
+    return event_mask;
+}
+
+/** Reads and decodes pending mixer events.
+ * Events are read from the control device in batches, so draining a burst
+ * of events costs one read per batch instead of one per event.
+ * The call blocks until at least one event is available, so it is usually
+ * called after @ref mixer_wait_event has reported that events are pending.
+ * Events must have been enabled with @ref mixer_subscribe_events.
+ * @param mixer A mixer handle.
+ * @param events An array to store the decoded events in.
+ * @param count The number of events that fit in @p events.
+ * @returns On success, the number of events stored in @p events.
+ *  On failure, -errno.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_read_event(struct mixer *mixer, struct mixer_ctl_event *events,
+                     unsigned int count)
+{
+    struct snd_ctl_event ev[16];
+    struct mixer_ctl_event *event;
+    struct pollfd pfd;
+    unsigned int batch;
+    unsigned int read_count;
+    unsigned int n = 0;
+    unsigned int i;
+    ssize_t bytes;
+    int first = 1;
+
+    if (!mixer || !events || !count)
+        return -EINVAL;
+
+    pfd.fd = mixer->fd;
+    pfd.events = POLLIN;
+
+    while (n < count) {
+        /* only the first read may block, later ones only drain what is
+         * already queued */
+        if (!first && (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)))
+            break;
+        first = 0;
+
+        batch = count - n;
+        if (batch > sizeof(ev) / sizeof(ev[0]))
+            batch = sizeof(ev) / sizeof(ev[0]);
+
+        bytes = read(mixer->fd, ev, batch * sizeof(ev[0]));
+        if (bytes < 0) {
+            if (n > 0)
+                break;
+            return -errno;
+        }
+
+        read_count = bytes / sizeof(ev[0]);
+        for (i = 0; i < read_count; i++) {
+            if (ev[i].type != SNDRV_CTL_EVENT_ELEM)
+                continue;
+            event = &events[n++];
+            event->mask = mixer_event_mask_from_alsa(ev[i].data.elem.mask);
+            event->id = ev[i].data.elem.id.numid - 1;
+            event->ctl = mixer_get_ctl_by_numid(mixer,
+                                                ev[i].data.elem.id.numid);
+        }
+
+        /* the driver had no more events queued, do not block for more */
+        if (read_count < batch)
+            break;
+    }
+
+    return n;
+}
+
+/** Consumes a single mixer event without decoding it.
+ * This clears an event reported by @ref mixer_wait_event,
+ * for callers that are not interested in which control changed.
+ * @param mixer A mixer handle.
+ * @returns On success, the number of events consumed (zero or one).
+ *  On failure, -errno.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_consume_event(struct mixer *mixer)
+{
+    struct mixer_ctl_event event;
+
+    return mixer_read_event(mixer, &event, 1);
+}
+
 /** Gets a mixer control handle, by the mixer control's id.
  * For non-const access, see @ref mixer_get_ctl
  * @param mixer An initialized mixer handle.
@@ -366,8 +1050,8 @@ int mixer_wait_event(struct mixer *mixer, int timeout)
  */
 const struct mixer_ctl *mixer_get_ctl_const(const struct mixer *mixer, unsigned int id)
 {
-    if (mixer && (id < mixer->count))
-        return mixer->ctl + id;
+    if (mixer && (id < mixer_count(mixer)))
+        return mixer_ctl_at(mixer, id);
 
     return NULL;
 }
@@ -381,8 +1065,8 @@ const struct mixer_ctl *mixer_get_ctl_const(const struct mixer *mixer, unsigned
  */
 struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
 {
-    if (mixer && (id < mixer->count))
-        return mixer->ctl + id;
+    if (mixer && (id < mixer_count(mixer)))
+        return mixer_ctl_at(mixer, id);
 
     return NULL;
 }
@@ -410,44 +1094,284 @@ struct mixer_ctl *mixer_get_ctl_by_name_and_index(struct mixer *mixer,
                                                   const char *name,
                                                   unsigned int index)
 {
+    const struct mixer_name_index *name_index;
+    const struct mixer_name_entry *entry;
+    unsigned int hash;
+    unsigned int pos;
+    unsigned int id;
     unsigned int n;
+    unsigned int count;
+    unsigned int indexed;
     struct mixer_ctl *ctl;
 
     if (!mixer)
         return NULL;
 
-    ctl = mixer->ctl;
+    count = mixer_count(mixer);
+    indexed = __atomic_load_n(&mixer->indexed, __ATOMIC_ACQUIRE);
+    name_index = __atomic_load_n(&mixer->index, __ATOMIC_ACQUIRE);
+    if (!name_index)
+        indexed = 0;
+
+    if (indexed) {
+        hash = mixer_name_hash(name);
+        for (pos = hash & name_index->mask; ;
+             pos = (pos + 1) & name_index->mask) {
+            entry = &name_index->entries[pos];
+            id = __atomic_load_n(&entry->id, __ATOMIC_ACQUIRE);
+            if (!id)
+                break;
+            if ((entry->hash != hash) || (id > indexed))
+                continue;
+            ctl = mixer_ctl_at(mixer, id - 1);
+            if (!strcmp(name, ctl->name))
+                if (index-- == 0)
+                    return ctl;
+        }
+    }
 
-    for (n = 0; n < mixer->count; n++)
-        if (!strcmp(name, (char*) ctl[n].info.id.name))
+    /* controls that could not be indexed */
+    for (n = indexed; n < count; n++) {
+        ctl = mixer_ctl_at(mixer, n);
+        if (!strcmp(name, ctl->name))
             if (index-- == 0)
-                return mixer->ctl + n;
+                return ctl;
+    }
 
     return NULL;
 }
 
-/** Updates the control's info.
- * This is useful for a program that may be idle for a period of time.
- * @param ctl An initialized control handle.
+/** The controls found by @ref mixer_find_ctls.
  * @ingroup libtinyalsa-mixer
  */
-void mixer_ctl_update(struct mixer_ctl *ctl)
+struct mixer_ctl_matches {
+    /** The ids of the controls */
+    unsigned int *ids;
+    /** The number of ids */
+    unsigned int count;
+    /** The number of ids that fit in @ref ids */
+    unsigned int size;
+};
+
+static int mixer_ctl_matches_add(struct mixer_ctl_matches *matches,
+                                 unsigned int id)
 {
-    ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_INFO, ctl->info);
+    unsigned int *ids;
+
+    if (matches->count == matches->size) {
+        matches->size = matches->size ? matches->size * 2 : 16;
+        ids = realloc(matches->ids, matches->size * sizeof(*ids));
+        if (!ids)
+            return -ENOMEM;
+        matches->ids = ids;
+    }
+
+    matches->ids[matches->count++] = id;
+    return 0;
 }
 
-/** Checks the control for TLV Read/Write access.
- * @param ctl An initialized control handle.
- * @returns On success, non-zero.
- *  On failure, zero.
- * @ingroup libtinyalsa-mixer
+/* Adds the controls below node that match the pattern, or all of them if
+ * pattern is NULL, in name order.
  */
-int mixer_ctl_is_access_tlv_rw(const struct mixer_ctl *ctl)
+static int mixer_trie_collect(const struct mixer *mixer,
+                              const struct mixer_trie_node *node,
+                              const char *pattern,
+                              struct mixer_ctl_matches *matches)
 {
-    return (ctl->info.access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE);
-}
+    const struct mixer_trie_node *child;
+    unsigned int n;
+    int ret;
 
-/** Gets the control's ID.
+    for (n = 0; n < node->num_ids; n++) {
+        if (pattern &&
+            fnmatch(pattern, mixer_ctl_at(mixer, node->ids[n])->name, 0) != 0)
+            break; /* the other ids have the same name */
+        ret = mixer_ctl_matches_add(matches, node->ids[n]);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (child = node->child; child; child = child->sibling) {
+        ret = mixer_trie_collect(mixer, child, pattern, matches);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/** Finds the controls whose name matches a pattern.
+ * The pattern is a shell wildcard pattern, as used by fnmatch(3),
+ * for instance "SLIMBUS_0_RX Audio Mixer *".
+ * A pattern without wildcards only matches the controls with that name.
+ * Names are kept in a trie, so only the controls that start with the part of
+ * the pattern before the first wildcard are looked at.
+ * The callback is called for each match, in name order, and for controls
+ * with the same name, in id order.
+ * If the mixer is shared between threads, the lookup serializes with
+ * @ref mixer_add_new_ctls, but the callbacks are called without holding a
+ * lock, so they may use the control.
+ * @param mixer An initialized mixer handle.
+ * @param pattern The pattern to match the control names against.
+ * @param callback The function to call for each matching control.
+ *  If it returns non-zero, no more controls are passed to it.
+ * @param data Passed to the callback.
+ * @returns On success, the number of controls passed to the callback.
+ *  On failure, -errno.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_find_ctls(struct mixer *mixer, const char *pattern,
+                    mixer_ctl_callback callback, void *data)
+{
+    struct mixer_ctl_matches matches;
+    const struct mixer_trie_node *node;
+    const struct mixer_trie_node *child;
+    const char *rest;
+    const char *end;
+    size_t prefix_length;
+    unsigned int common;
+    int inside = 0;
+    unsigned int count;
+    unsigned int n;
+    int ret = 0;
+
+    if (!mixer || !pattern || !callback)
+        return -EINVAL;
+
+    memset(&matches, 0, sizeof(matches));
+    prefix_length = strcspn(pattern, "*?[\\");
+
+    mixer_lock(mixer);
+
+    /* walk down the part of the pattern before the first wildcard */
+    node = mixer->trie;
+    rest = pattern;
+    end = pattern + prefix_length;
+    while (node && (rest < end)) {
+        for (child = node->child; child; child = child->sibling)
+            if (child->label[0] == *rest)
+                break;
+        node = child;
+        if (!node)
+            break;
+
+        for (common = 1; (common < node->length) && (rest + common < end); common++)
+            if (node->label[common] != rest[common])
+                break;
+        if (common < node->length) {
+            if (rest + common < end)
+                node = NULL; /* no name starts with the prefix */
+            else
+                inside = 1; /* the prefix ends part way through the label */
+        }
+        rest += common;
+    }
+
+    if (node) {
+        if (*end == '\0') {
+            /* no wildcards, only the names that end at the node match */
+            for (n = 0; !inside && (ret == 0) && (n < node->num_ids); n++)
+                ret = mixer_ctl_matches_add(&matches, node->ids[n]);
+        } else if (!strcmp(end, "*")) {
+            /* every name below the node matches */
+            ret = mixer_trie_collect(mixer, node, NULL, &matches);
+        } else {
+            ret = mixer_trie_collect(mixer, node, pattern, &matches);
+        }
+    }
+
+    /* controls that could not be put in the trie */
+    count = mixer_count(mixer);
+    for (n = mixer->trie_count; (ret == 0) && (n < count); n++)
+        if (fnmatch(pattern, mixer_ctl_at(mixer, n)->name, 0) == 0)
+            ret = mixer_ctl_matches_add(&matches, n);
+
+    mixer_unlock(mixer);
+
+    if (ret == 0) {
+        for (n = 0; n < matches.count; n++)
+            if (callback(mixer_ctl_at(mixer, matches.ids[n]), data) != 0)
+                break;
+        ret = (n < matches.count) ? (int) n + 1 : (int) matches.count;
+    }
+
+    free(matches.ids);
+    return ret;
+}
+
+/** Updates the control's info.
+ * This is useful for a program that may be idle for a period of time.
+ * @param ctl An initialized control handle.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_ctl_update(struct mixer_ctl *ctl)
+{
+    struct snd_ctl_elem_info ei;
+
+    struct mixer *mixer = ctl->mixer;
+    struct mixer_retired *retired;
+    struct mixer_ctl_info *info;
+    struct mixer_ctl_db *db;
+    struct mixer_enames *ename;
+
+    memset(&ei, 0, sizeof(ei));
+    ei.id.numid = ctl->numid;
+    if (ioctl(mixer->fd, SNDRV_CTL_IOCTL_ELEM_INFO, &ei) < 0)
+        return;
+
+    mixer_lock(mixer);
+
+    if (!mixer->thread_safe) {
+        mixer_free_enames(ctl->ename);
+        free(ctl->db);
+        if (ctl->info != &ctl->base)
+            free(ctl->info);
+        ctl->ename = NULL;
+        ctl->db = NULL;
+        mixer_ctl_set_info(&ctl->base, &ei);
+        ctl->info = &ctl->base;
+        mixer_unlock(mixer);
+        return;
+    }
+
+    /* readers may use the old info, names and dB table until the mixer is
+     * closed, the new info is published as a whole */
+    info = malloc(sizeof(*info));
+    retired = malloc(sizeof(*retired));
+    if (!info || !retired) {
+        free(info);
+        free(retired);
+        mixer_unlock(mixer);
+        return;
+    }
+    mixer_ctl_set_info(info, &ei);
+
+    /* the enumerated items and the range may have changed as well */
+    ename = __atomic_exchange_n(&ctl->ename, NULL, __ATOMIC_ACQ_REL);
+    db = __atomic_exchange_n(&ctl->db, NULL, __ATOMIC_ACQ_REL);
+    info = __atomic_exchange_n(&ctl->info, info, __ATOMIC_ACQ_REL);
+
+    retired->ename = ename;
+    retired->db = db;
+    retired->info = info != &ctl->base ? info : NULL;
+    retired->next = mixer->retired;
+    mixer->retired = retired;
+
+    mixer_unlock(mixer);
+}
+
+/** Checks the control for TLV Read/Write access.
+ * @param ctl An initialized control handle.
+ * @returns On success, non-zero.
+ *  On failure, zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_is_access_tlv_rw(const struct mixer_ctl *ctl)
+{
+    return (mixer_ctl_info(ctl)->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE);
+}
+
+/** Gets the control's ID.
  * @param ctl An initialized control handle.
  * @returns On success, the control's ID is returned.
  *  On error, UINT_MAX is returned instead.
@@ -461,7 +1385,7 @@ unsigned int mixer_ctl_get_id(const struct mixer_ctl *ctl)
     /* numid values start at 1, return a 0-base value that
      * can be passed to mixer_get_ctl()
      */
-    return ctl->info.id.numid - 1;
+    return ctl->numid - 1;
 }
 
 /** Gets the name of the control.
@@ -475,7 +1399,7 @@ const char *mixer_ctl_get_name(const struct mixer_ctl *ctl)
     if (!ctl)
         return NULL;
 
-    return (const char *)ctl->info.id.name;
+    return ctl->name;
 }
 
 /** Gets the value type of the control.
@@ -489,7 +1413,7 @@ enum mixer_ctl_type mixer_ctl_get_type(const struct mixer_ctl *ctl)
     if (!ctl)
         return MIXER_CTL_TYPE_UNKNOWN;
 
-    switch (ctl->info.type) {
+    switch (mixer_ctl_info(ctl)->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:    return MIXER_CTL_TYPE_BOOL;
     case SNDRV_CTL_ELEM_TYPE_INTEGER:    return MIXER_CTL_TYPE_INT;
     case SNDRV_CTL_ELEM_TYPE_ENUMERATED: return MIXER_CTL_TYPE_ENUM;
@@ -510,7 +1434,7 @@ const char *mixer_ctl_get_type_string(const struct mixer_ctl *ctl)
     if (!ctl)
         return "";
 
-    switch (ctl->info.type) {
+    switch (mixer_ctl_info(ctl)->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:    return "BOOL";
     case SNDRV_CTL_ELEM_TYPE_INTEGER:    return "INT";
     case SNDRV_CTL_ELEM_TYPE_ENUMERATED: return "ENUM";
@@ -531,28 +1455,28 @@ unsigned int mixer_ctl_get_num_values(const struct mixer_ctl *ctl)
     if (!ctl)
         return 0;
 
-    return ctl->info.count;
+    return mixer_ctl_info(ctl)->count;
 }
 
-static int percent_to_int(const struct snd_ctl_elem_info *ei, int percent)
+static int percent_to_int(const struct mixer_ctl_info *info, int percent)
 {
     if ((percent > 100) || (percent < 0)) {
         return -EINVAL;
     }
 
-    int range = (ei->value.integer.max - ei->value.integer.min);
+    int range = (info->value.integer.max - info->value.integer.min);
 
-    return ei->value.integer.min + (range * percent) / 100;
+    return info->value.integer.min + (range * percent) / 100;
 }
 
-static int int_to_percent(const struct snd_ctl_elem_info *ei, int value)
+static int int_to_percent(const struct mixer_ctl_info *info, int value)
 {
-    int range = (ei->value.integer.max - ei->value.integer.min);
+    int range = (info->value.integer.max - info->value.integer.min);
 
     if (range == 0)
         return 0;
 
-    return ((value - ei->value.integer.min) * 100) / range;
+    return ((value - info->value.integer.min) * 100) / range;
 }
 
 /** Gets a percentage representation of a specified control value.
@@ -564,10 +1488,16 @@ static int int_to_percent(const struct snd_ctl_elem_info *ei, int value)
  */
 int mixer_ctl_get_percent(const struct mixer_ctl *ctl, unsigned int id)
 {
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_INTEGER))
+    const struct mixer_ctl_info *info;
+
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (info->type != SNDRV_CTL_ELEM_TYPE_INTEGER)
         return -EINVAL;
 
-    return int_to_percent(&ctl->info, mixer_ctl_get_value(ctl, id));
+    return int_to_percent(info, mixer_ctl_get_value(ctl, id));
 }
 
 /** Sets the value of a control by percent, specified by the value index.
@@ -580,10 +1510,72 @@ int mixer_ctl_get_percent(const struct mixer_ctl *ctl, unsigned int id)
  */
 int mixer_ctl_set_percent(struct mixer_ctl *ctl, unsigned int id, int percent)
 {
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_INTEGER))
+    const struct mixer_ctl_info *info;
+
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (info->type != SNDRV_CTL_ELEM_TYPE_INTEGER)
+        return -EINVAL;
+
+    return mixer_ctl_set_value(ctl, id, percent_to_int(info, percent));
+}
+
+/** Sets the first @p count values of a control by percent, at once.
+ * The control is written with a single ioctl, see @ref mixer_ctl_set_values.
+ * @param ctl An initialized control handle.
+ * @param percent The percentages to set, between 0 and 100.
+ * @param count The number of values in @p percent.
+ *  This must not be greater than the number of values in the control.
+ * @returns On success, zero is returned.
+ *  On failure, non-zero is returned.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_percent_array(struct mixer_ctl *ctl, const int *percent,
+                                unsigned int count)
+{
+    struct snd_ctl_elem_value ev;
+    int values[sizeof(ev.value.integer.value) / sizeof(ev.value.integer.value[0])];
+    const struct mixer_ctl_info *info;
+    unsigned int id;
+
+    if (!ctl || !percent || (count > sizeof(values) / sizeof(values[0])))
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (info->type != SNDRV_CTL_ELEM_TYPE_INTEGER)
         return -EINVAL;
 
-    return mixer_ctl_set_value(ctl, id, percent_to_int(&ctl->info, percent));
+    for (id = 0; id < count; id++) {
+        if ((percent[id] > 100) || (percent[id] < 0))
+            return -EINVAL;
+        values[id] = percent_to_int(info, percent[id]);
+    }
+
+    return mixer_ctl_set_values(ctl, values, count);
+}
+
+static int mixer_ctl_load_value(const struct mixer_ctl_info *info,
+                                const struct snd_ctl_elem_value *ev,
+                                unsigned int id)
+{
+    switch (info->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+        return !!ev->value.integer.value[id];
+
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+        return ev->value.integer.value[id];
+
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        return ev->value.enumerated.item[id];
+
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        return ev->value.bytes.data[id];
+
+    default:
+        return -EINVAL;
+    }
 }
 
 /** Gets the value of a control.
@@ -595,35 +1587,75 @@ int mixer_ctl_set_percent(struct mixer_ctl *ctl, unsigned int id, int percent)
  */
 int mixer_ctl_get_value(const struct mixer_ctl *ctl, unsigned int id)
 {
+    const struct mixer_ctl_info *info;
     struct snd_ctl_elem_value ev;
     int ret;
 
-    if (!ctl || (id >= ctl->info.count))
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (id >= info->count)
         return -EINVAL;
 
     memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info.id.numid;
+    ev.id.numid = ctl->numid;
     ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
     if (ret < 0)
         return ret;
 
-    switch (ctl->info.type) {
-    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
-        return !!ev.value.integer.value[id];
+    return mixer_ctl_load_value(info, &ev, id);
+}
 
-    case SNDRV_CTL_ELEM_TYPE_INTEGER:
-        return ev.value.integer.value[id];
+/** Gets the first @p count values of a control at once.
+ * Unlike calling @ref mixer_ctl_get_value for each index, the control is
+ * read with a single ioctl.
+ * Only boolean, integer, enumerated and (non TLV) byte controls are supported.
+ * @param ctl An initialized control handle.
+ * @param values The array to store the values in, starting at index zero.
+ * @param count The number of values to get.
+ *  This must not be greater than the number of values in the control.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_get_values(const struct mixer_ctl *ctl, int *values,
+                         unsigned int count)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_elem_value ev;
+    unsigned int id;
+    int ret;
 
-    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
-        return ev.value.enumerated.item[id];
+    if (!ctl || !values || !count)
+        return -EINVAL;
 
-    case SNDRV_CTL_ELEM_TYPE_BYTES:
-        return ev.value.bytes.data[id];
+    info = mixer_ctl_info(ctl);
+    if (count > info->count)
+        return -EINVAL;
 
+    switch (info->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        break;
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        if (info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE)
+            return -EINVAL;
+        break;
     default:
         return -EINVAL;
     }
 
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
+    ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+    if (ret < 0)
+        return ret;
+
+    for (id = 0; id < count; id++)
+        values[id] = mixer_ctl_load_value(info, &ev, id);
+
     return 0;
 }
 
@@ -632,6 +1664,9 @@ int mixer_ctl_get_value(const struct mixer_ctl *ctl, unsigned int id)
  * @param array A pointer to write the array data to.
  *  The size of this array must be equal to the number of items in the array
  *  multiplied by the size of each item.
+ *  Items are long for boolean and integer controls, long long for 64 bit
+ *  integer controls, struct mixer_iec958 for IEC958 controls and bytes for
+ *  byte controls.
  * @param count The number of items in the array.
  *  This parameter must match the number of items in the control.
  *  The number of items in the control may be accessed via @ref mixer_ctl_get_num_values
@@ -641,6 +1676,7 @@ int mixer_ctl_get_value(const struct mixer_ctl *ctl, unsigned int id)
  */
 int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
 {
+    const struct mixer_ctl_info *info;
     struct snd_ctl_elem_value ev;
     int ret = 0;
     size_t size;
@@ -650,10 +1686,11 @@ int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
     if (!ctl || !count || !array)
         return -EINVAL;
 
-    total_count = ctl->info.count;
+    info = mixer_ctl_info(ctl);
+    total_count = info->count;
 
-    if ((ctl->info.type == SNDRV_CTL_ELEM_TYPE_BYTES) &&
-        (mixer_ctl_is_access_tlv_rw(ctl))) {
+    if ((info->type == SNDRV_CTL_ELEM_TYPE_BYTES) &&
+        (info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE)) {
             /* Additional two words is for the TLV header */
             total_count += TLV_HEADER_SIZE;
     }
@@ -662,9 +1699,9 @@ int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
         return -EINVAL;
 
     memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info.id.numid;
+    ev.id.numid = ctl->numid;
 
-    switch (ctl->info.type) {
+    switch (info->type) {
     case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
     case SNDRV_CTL_ELEM_TYPE_INTEGER:
         ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
@@ -674,9 +1711,27 @@ int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
         source = ev.value.integer.value;
         break;
 
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+        if (ret < 0)
+            return ret;
+        size = sizeof(ev.value.integer64.value[0]);
+        source = ev.value.integer64.value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_IEC958:
+        if (count > 1)
+            return -EINVAL;
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+        if (ret < 0)
+            return ret;
+        size = sizeof(ev.value.iec958);
+        source = &ev.value.iec958;
+        break;
+
     case SNDRV_CTL_ELEM_TYPE_BYTES:
         /* check if this is new bytes TLV */
-        if (mixer_ctl_is_access_tlv_rw(ctl)) {
+        if (info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE) {
             struct snd_ctl_tlv *tlv;
             int ret;
 
@@ -685,7 +1740,7 @@ int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
             tlv = calloc(1, sizeof(*tlv) + count);
             if (!tlv)
                 return -ENOMEM;
-            tlv->numid = ctl->info.id.numid;
+            tlv->numid = ctl->numid;
             tlv->length = count;
             ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_READ, tlv);
 
@@ -713,133 +1768,509 @@ int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
     return 0;
 }
 
-/** Sets the value of a control, specified by the value index.
- * @param ctl An initialized control handle.
+/* struct mixer_iec958 is copied to and from struct snd_aes_iec958 as is */
+_Static_assert(sizeof(struct mixer_iec958) == sizeof(struct snd_aes_iec958),
+               "struct mixer_iec958 does not match struct snd_aes_iec958");
+
+/** Gets the value of a 64 bit integer control.
+ * @param ctl An initialized control handle of type @ref MIXER_CTL_TYPE_INT64.
  * @param id The index of the value within the control.
- * @param value The value to set.
- *  This must be in a range specified by @ref mixer_ctl_get_range_min
- *  and @ref mixer_ctl_get_range_max.
- * @returns On success, zero is returned.
- *  On failure, non-zero is returned.
+ * @param value Receives the value.
+ * @returns On success, zero.
+ *  On failure, non-zero.
  * @ingroup libtinyalsa-mixer
  */
-int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
+int mixer_ctl_get_value64(const struct mixer_ctl *ctl, unsigned int id,
+                          long long *value)
 {
+    const struct mixer_ctl_info *info;
     struct snd_ctl_elem_value ev;
     int ret;
 
-    if (!ctl || (id >= ctl->info.count))
+    if (!ctl || !value)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if ((info->type != SNDRV_CTL_ELEM_TYPE_INTEGER64) || (id >= info->count))
         return -EINVAL;
 
     memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info.id.numid;
+    ev.id.numid = ctl->numid;
     ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
     if (ret < 0)
         return ret;
 
-    switch (ctl->info.type) {
-    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
-        ev.value.integer.value[id] = !!value;
-        break;
+    *value = ev.value.integer64.value[id];
+    return 0;
+}
 
-    case SNDRV_CTL_ELEM_TYPE_INTEGER:
-        if ((value < mixer_ctl_get_range_min(ctl)) ||
-            (value > mixer_ctl_get_range_max(ctl))) {
-            return -EINVAL;
-        }
+/** Sets the value of a 64 bit integer control.
+ * @param ctl An initialized control handle of type @ref MIXER_CTL_TYPE_INT64.
+ * @param id The index of the value within the control.
+ * @param value The value to set.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_value64(struct mixer_ctl *ctl, unsigned int id,
+                          long long value)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_elem_value ev;
+    int ret;
 
-        ev.value.integer.value[id] = value;
-        break;
+    if (!ctl)
+        return -EINVAL;
 
-    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
-        ev.value.enumerated.item[id] = value;
-        break;
+    info = mixer_ctl_info(ctl);
+    if ((info->type != SNDRV_CTL_ELEM_TYPE_INTEGER64) || (id >= info->count))
+        return -EINVAL;
 
-    case SNDRV_CTL_ELEM_TYPE_BYTES:
-        ev.value.bytes.data[id] = value;
-        break;
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
 
-    default:
-        return -EINVAL;
+    mixer_lock(ctl->mixer);
+    ret = 0;
+    if (info->count > 1)
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+    if (ret == 0) {
+        ev.value.integer64.value[id] = value;
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
     }
+    mixer_unlock(ctl->mixer);
 
-    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    return ret;
 }
 
-/** Sets the contents of a control's value array.
- * @param ctl An initialized control handle.
- * @param array The array containing control values.
- * @param count The number of values in the array.
- *  This must match the number of values in the control.
- *  The number of values in a control may be accessed via @ref mixer_ctl_get_num_values
+/** Gets the IEC958 (S/PDIF, HDMI) channel status, subcode and subframe bits
+ * of a control.
+ * @param ctl An initialized control handle of type @ref MIXER_CTL_TYPE_IEC958.
+ * @param iec958 Receives the bits.
  * @returns On success, zero.
  *  On failure, non-zero.
  * @ingroup libtinyalsa-mixer
  */
-int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+int mixer_ctl_get_iec958(const struct mixer_ctl *ctl,
+                         struct mixer_iec958 *iec958)
 {
     struct snd_ctl_elem_value ev;
-    size_t size;
-    void *dest;
-    size_t total_count;
+    int ret;
 
-    if ((!ctl) || !count || !array)
+    if (!ctl || !iec958 ||
+        (mixer_ctl_info(ctl)->type != SNDRV_CTL_ELEM_TYPE_IEC958))
         return -EINVAL;
 
-    total_count = ctl->info.count;
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
+    ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+    if (ret < 0)
+        return ret;
+
+    memcpy(iec958, &ev.value.iec958, sizeof(*iec958));
+    return 0;
+}
 
-    if ((ctl->info.type == SNDRV_CTL_ELEM_TYPE_BYTES) &&
-        (mixer_ctl_is_access_tlv_rw(ctl))) {
-            /* Additional TLV header */
-            total_count += TLV_HEADER_SIZE;
-    }
+/** Sets the IEC958 (S/PDIF, HDMI) channel status, subcode and subframe bits
+ * of a control.
+ * @param ctl An initialized control handle of type @ref MIXER_CTL_TYPE_IEC958.
+ * @param iec958 The bits to set.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_iec958(struct mixer_ctl *ctl,
+                         const struct mixer_iec958 *iec958)
+{
+    struct snd_ctl_elem_value ev;
 
-    if (count > total_count)
+    if (!ctl || !iec958 ||
+        (mixer_ctl_info(ctl)->type != SNDRV_CTL_ELEM_TYPE_IEC958))
         return -EINVAL;
 
     memset(&ev, 0, sizeof(ev));
-    ev.id.numid = ctl->info.id.numid;
+    ev.id.numid = ctl->numid;
+    memcpy(&ev.value.iec958, iec958, sizeof(*iec958));
+    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+}
 
-    switch (ctl->info.type) {
-    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
-    case SNDRV_CTL_ELEM_TYPE_INTEGER:
-        size = sizeof(ev.value.integer.value[0]);
-        dest = ev.value.integer.value;
-        break;
+static int mixer_ctl_check_value(const struct mixer_ctl_info *info,
+                                 unsigned int id, int value)
+{
+    if (id >= info->count)
+        return -EINVAL;
 
+    switch (info->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
     case SNDRV_CTL_ELEM_TYPE_BYTES:
-        /* check if this is new bytes TLV */
-        if (mixer_ctl_is_access_tlv_rw(ctl)) {
-            struct snd_ctl_tlv *tlv;
-            int ret = 0;
-            if (count > SIZE_MAX - sizeof(*tlv))
-                return -EINVAL;
-            tlv = calloc(1, sizeof(*tlv) + count);
-            if (!tlv)
-                return -ENOMEM;
-            tlv->numid = ctl->info.id.numid;
-            tlv->length = count;
-            memcpy(tlv->tlv, array, count);
-
-            ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_WRITE, tlv);
-            free(tlv);
+        return 0;
 
-            return ret;
-        } else {
-            size = sizeof(ev.value.bytes.data[0]);
-            dest = ev.value.bytes.data;
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+        if ((value < info->value.integer.min) ||
+            (value > info->value.integer.max)) {
+            return -EINVAL;
         }
-        break;
+        return 0;
 
     default:
         return -EINVAL;
     }
+}
 
-    memcpy(dest, array, size * count);
+/* Stores a value, which must have passed mixer_ctl_check_value(), in an
+ * element value.
+ */
+static void mixer_ctl_store_value(const struct mixer_ctl_info *info,
+                                  struct snd_ctl_elem_value *ev,
+                                  unsigned int id, int value)
+{
+    switch (info->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+        ev->value.integer.value[id] = !!value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+        ev->value.integer.value[id] = value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_ENUMERATED:
+        ev->value.enumerated.item[id] = value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        ev->value.bytes.data[id] = value;
+        break;
+    }
+}
+
+/** Sets the value of a control, specified by the value index.
+ * @param ctl An initialized control handle.
+ * @param id The index of the value within the control.
+ * @param value The value to set.
+ *  This must be in a range specified by @ref mixer_ctl_get_range_min
+ *  and @ref mixer_ctl_get_range_max.
+ * @returns On success, zero is returned.
+ *  On failure, non-zero is returned.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_elem_value ev;
+    int ret;
+
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (mixer_ctl_check_value(info, id, value) != 0)
+        return -EINVAL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
+
+    mixer_lock(ctl->mixer);
+    ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+    if (ret == 0) {
+        mixer_ctl_store_value(info, &ev, id, value);
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    }
+    mixer_unlock(ctl->mixer);
+
+    return ret;
+}
+
+/** Sets the first @p count values of a control at once.
+ * Unlike calling @ref mixer_ctl_set_value for each index, the control is
+ * written with a single ioctl. If @p count is less than the number of values
+ * in the control, the remaining values are read first so that they are
+ * preserved.
+ * @param ctl An initialized control handle.
+ * @param values The values to set, starting at index zero.
+ * @param count The number of values in @p values.
+ *  This must not be greater than the number of values in the control.
+ * @returns On success, zero is returned.
+ *  On failure, non-zero is returned.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_values(struct mixer_ctl *ctl, const int *values,
+                         unsigned int count)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_elem_value ev;
+    unsigned int id;
+    int ret;
+
+    if (!ctl || !values || !count)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (count > info->count)
+        return -EINVAL;
+
+    for (id = 0; id < count; id++)
+        if (mixer_ctl_check_value(info, id, values[id]) != 0)
+            return -EINVAL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
+
+    mixer_lock(ctl->mixer);
+    ret = 0;
+    if (count < info->count)
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+    if (ret == 0) {
+        for (id = 0; id < count; id++)
+            mixer_ctl_store_value(info, &ev, id, values[id]);
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+    }
+    mixer_unlock(ctl->mixer);
+
+    return ret;
+}
+
+/** Sets the contents of a control's value array.
+ * @param ctl An initialized control handle.
+ * @param array The array containing control values.
+ *  The items have the types listed for @ref mixer_ctl_get_array.
+ * @param count The number of values in the array.
+ *  This must match the number of values in the control.
+ *  The number of values in a control may be accessed via @ref mixer_ctl_get_num_values
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_elem_value ev;
+    size_t size;
+    void *dest;
+    size_t total_count;
+
+    if ((!ctl) || !count || !array)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    total_count = info->count;
+
+    if ((info->type == SNDRV_CTL_ELEM_TYPE_BYTES) &&
+        (info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE)) {
+            /* Additional TLV header */
+            total_count += TLV_HEADER_SIZE;
+    }
+
+    if (count > total_count)
+        return -EINVAL;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.id.numid = ctl->numid;
+
+    switch (info->type) {
+    case SNDRV_CTL_ELEM_TYPE_BOOLEAN:
+    case SNDRV_CTL_ELEM_TYPE_INTEGER:
+        size = sizeof(ev.value.integer.value[0]);
+        dest = ev.value.integer.value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_INTEGER64:
+        size = sizeof(ev.value.integer64.value[0]);
+        dest = ev.value.integer64.value;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_IEC958:
+        if (count > 1)
+            return -EINVAL;
+        size = sizeof(ev.value.iec958);
+        dest = &ev.value.iec958;
+        break;
+
+    case SNDRV_CTL_ELEM_TYPE_BYTES:
+        /* check if this is new bytes TLV */
+        if (info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE) {
+            struct snd_ctl_tlv *tlv;
+            int ret = 0;
+            if (count > SIZE_MAX - sizeof(*tlv))
+                return -EINVAL;
+            tlv = calloc(1, sizeof(*tlv) + count);
+            if (!tlv)
+                return -ENOMEM;
+            tlv->numid = ctl->numid;
+            tlv->length = count;
+            memcpy(tlv->tlv, array, count);
+
+            ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_WRITE, tlv);
+            free(tlv);
+
+            return ret;
+        } else {
+            size = sizeof(ev.value.bytes.data[0]);
+            dest = ev.value.bytes.data;
+        }
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    memcpy(dest, array, size * count);
 
     return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
 }
 
+/* Returns the info of a TLV byte control that a buffer can be passed to in
+ * place, or NULL.
+ */
+static const struct mixer_ctl_info *mixer_ctl_check_tlv_in_place(const struct mixer_ctl *ctl,
+                                                                 const void *buffer,
+                                                                 size_t count)
+{
+    const struct mixer_ctl_info *info;
+
+    if (!ctl || !buffer || !count)
+        return NULL;
+
+    info = mixer_ctl_info(ctl);
+    if ((info->type != SNDRV_CTL_ELEM_TYPE_BYTES) ||
+        !(info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READWRITE))
+        return NULL;
+
+    /* the ioctl header is written into the buffer */
+    if ((uintptr_t) buffer % sizeof(unsigned int))
+        return NULL;
+
+    return info;
+}
+
+/** Gets the contents of a TLV byte control into a caller owned buffer.
+ * Unlike @ref mixer_ctl_get_array, no memory is allocated and the data is
+ * not copied: the first @ref TLV_HEADER_SIZE bytes of @p buffer are
+ * used for the ioctl header and the driver writes the data right after it.
+ * @param ctl An initialized control handle.
+ *  The control must be a byte control with TLV read/write access.
+ * @param buffer The buffer to read into. It must be aligned to an unsigned
+ *  int and @ref TLV_HEADER_SIZE + @p count bytes large.
+ *  The data starts at @p buffer + @ref TLV_HEADER_SIZE.
+ * @param count The number of bytes to read, as for @ref mixer_ctl_get_array.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_get_array_in_place(const struct mixer_ctl *ctl, void *buffer,
+                                 size_t count)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_tlv *tlv = buffer;
+
+    info = mixer_ctl_check_tlv_in_place(ctl, buffer, count);
+    if (!info || count > info->count + TLV_HEADER_SIZE)
+        return -EINVAL;
+
+    tlv->numid = ctl->numid;
+    tlv->length = count;
+    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_READ, tlv);
+}
+
+/** Sets the contents of a TLV byte control from a caller owned buffer.
+ * Unlike @ref mixer_ctl_set_array, no memory is allocated and the data is
+ * not copied: the first @ref TLV_HEADER_SIZE bytes of @p buffer are
+ * overwritten with the ioctl header and the buffer is passed to the driver
+ * as is.
+ * @param ctl An initialized control handle.
+ *  The control must be a byte control with TLV read/write access.
+ * @param buffer The buffer to write. It must be aligned to an unsigned int,
+ *  the data must start at @p buffer + @ref TLV_HEADER_SIZE.
+ * @param count The number of bytes to write, as for @ref mixer_ctl_set_array.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_array_in_place(struct mixer_ctl *ctl, void *buffer,
+                                 size_t count)
+{
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_tlv *tlv = buffer;
+
+    info = mixer_ctl_check_tlv_in_place(ctl, buffer, count);
+    if (!info || count > info->count + TLV_HEADER_SIZE)
+        return -EINVAL;
+
+    tlv->numid = ctl->numid;
+    tlv->length = count;
+    return ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_WRITE, tlv);
+}
+
+/** Writes a blob that is larger than a single transfer to a TLV byte
+ * control, in chunks.
+ * The blob is split into pieces of @p chunk_size bytes, each of which is
+ * written with its own ioctl. The driver must understand this segmentation,
+ * e.g. by a header that the caller placed at the start of every chunk.
+ * Like @ref mixer_ctl_set_array_in_place, nothing is allocated or copied:
+ * the ioctl header of each chunk is written into the bytes right before it,
+ * which are restored once the chunk has been written.
+ * @param ctl An initialized control handle.
+ *  The control must be a byte control with TLV read/write access.
+ * @param buffer The buffer to write. It must be aligned to an unsigned int,
+ *  the data must start at @p buffer + @ref TLV_HEADER_SIZE.
+ *  The buffer is modified while this function runs.
+ * @param count The size of the blob in bytes.
+ * @param chunk_size The maximum number of bytes written at once.
+ *  It must be a multiple of the size of an unsigned int and must not be
+ *  greater than the size of the control plus @ref TLV_HEADER_SIZE.
+ *  A last chunk smaller than @ref TLV_HEADER_SIZE, which the driver would
+ *  reject, is written together with the chunk before it.
+ * @returns On success, zero.
+ *  On failure, non-zero. The chunks before the failing one have been written.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_array_chunked(struct mixer_ctl *ctl, void *buffer,
+                                size_t count, size_t chunk_size)
+{
+    unsigned char *data = (unsigned char *)buffer + TLV_HEADER_SIZE;
+    unsigned char saved[TLV_HEADER_SIZE];
+    const struct mixer_ctl_info *info;
+    struct snd_ctl_tlv *tlv;
+    size_t offset;
+    size_t size;
+    size_t tail;
+    int ret;
+
+    info = mixer_ctl_check_tlv_in_place(ctl, buffer, count);
+    if (!info)
+        return -EINVAL;
+
+    if (!chunk_size || (chunk_size % sizeof(unsigned int)) ||
+        (chunk_size > info->count + TLV_HEADER_SIZE))
+        return -EINVAL;
+
+    tail = count > chunk_size ? count % chunk_size : 0;
+    if (tail >= TLV_HEADER_SIZE)
+        tail = 0;
+    if (chunk_size + tail > info->count + TLV_HEADER_SIZE)
+        return -EINVAL;
+
+    /* chunks of concurrent writers must not interleave */
+    mixer_lock(ctl->mixer);
+    ret = 0;
+    for (offset = 0; offset < count; offset += size) {
+        size = count - offset;
+        if (size > chunk_size + tail)
+            size = chunk_size;
+
+        tlv = (struct snd_ctl_tlv *)(data + offset - TLV_HEADER_SIZE);
+        memcpy(saved, tlv, sizeof(saved));
+        tlv->numid = ctl->numid;
+        tlv->length = size;
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_WRITE, tlv);
+        memcpy(tlv, saved, sizeof(saved));
+        if (ret < 0)
+            break;
+    }
+    mixer_unlock(ctl->mixer);
+
+    return ret < 0 ? ret : 0;
+}
+
 /** Gets the minimum value of an control.
  * The control must have an integer type.
  * The type of the control can be checked with @ref mixer_ctl_get_type.
@@ -850,10 +2281,16 @@ int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
  */
 int mixer_ctl_get_range_min(const struct mixer_ctl *ctl)
 {
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_INTEGER))
+    const struct mixer_ctl_info *info;
+
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (info->type != SNDRV_CTL_ELEM_TYPE_INTEGER)
         return -EINVAL;
 
-    return ctl->info.value.integer.min;
+    return info->value.integer.min;
 }
 
 /** Gets the maximum value of an control.
@@ -866,10 +2303,424 @@ int mixer_ctl_get_range_min(const struct mixer_ctl *ctl)
  */
 int mixer_ctl_get_range_max(const struct mixer_ctl *ctl)
 {
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_INTEGER))
+    const struct mixer_ctl_info *info;
+
+    if (!ctl)
+        return -EINVAL;
+
+    info = mixer_ctl_info(ctl);
+    if (info->type != SNDRV_CTL_ELEM_TYPE_INTEGER)
+        return -EINVAL;
+
+    return info->value.integer.max;
+}
+
+/* Converts a raw value to 1/100 dB following a dB TLV, as alsa-lib does.
+ * Returns -EINVAL if the TLV holds no dB information for the value.
+ */
+static int mixer_tlv_to_db(const unsigned int *tlv, unsigned int words,
+                           int rangemin, int rangemax, int value, int *db)
+{
+    unsigned int type;
+    unsigned int size;
+    unsigned int pos;
+    int min, max, step;
+    double lmin, lmax, val;
+
+    if (words < 2)
+        return -EINVAL;
+
+    type = tlv[0];
+    size = tlv[1] / sizeof(unsigned int);
+    if (size > words - 2)
+        return -EINVAL;
+    tlv += 2;
+
+    switch (type) {
+    case SNDRV_CTL_TLVT_CONTAINER:
+        for (pos = 0; pos + 2 <= size; pos += 2 + tlv[pos + 1] / sizeof(unsigned int))
+            if (mixer_tlv_to_db(tlv + pos, size - pos, rangemin, rangemax,
+                                value, db) == 0)
+                return 0;
+        return -EINVAL;
+
+    case SNDRV_CTL_TLVT_DB_RANGE:
+        /* triples of minimum raw value, maximum raw value and a dB TLV */
+        for (pos = 0; pos + 4 <= size; pos += 4 + tlv[pos + 3] / sizeof(unsigned int)) {
+            min = tlv[pos];
+            max = tlv[pos + 1];
+            if (value >= min && value <= max)
+                return mixer_tlv_to_db(tlv + pos + 2, size - pos - 2, min, max,
+                                       value, db);
+        }
+        return -EINVAL;
+
+    case SNDRV_CTL_TLVT_DB_SCALE:
+        if (size < 2)
+            return -EINVAL;
+        min = tlv[0];
+        step = tlv[1] & 0xffff;
+        if ((tlv[1] & 0x10000) && value == rangemin)
+            *db = MIXER_CTL_DB_MUTE;
+        else
+            *db = min + (value - rangemin) * step;
+        return 0;
+
+    case SNDRV_CTL_TLVT_DB_MINMAX:
+    case SNDRV_CTL_TLVT_DB_MINMAX_MUTE:
+        if (size < 2)
+            return -EINVAL;
+        min = tlv[0];
+        max = tlv[1];
+        if (type == SNDRV_CTL_TLVT_DB_MINMAX_MUTE && value == rangemin)
+            *db = MIXER_CTL_DB_MUTE;
+        else if (rangemax == rangemin)
+            *db = min;
+        else
+            *db = min + (int) (((long long) (max - min) * (value - rangemin)) /
+                               (rangemax - rangemin));
+        return 0;
+
+    case SNDRV_CTL_TLVT_DB_LINEAR:
+        if (size < 2)
+            return -EINVAL;
+        min = tlv[0];
+        max = tlv[1];
+        if (value <= rangemin) {
+            *db = min;
+        } else if (value >= rangemax) {
+            *db = max;
+        } else {
+            val = (double) (value - rangemin) / (rangemax - rangemin);
+            if (min <= MIXER_CTL_DB_MUTE) {
+                /* the scale runs from silence up to max */
+                *db = (int) lrint(2000.0 * log10(val)) + max;
+            } else {
+                lmin = pow(10.0, min / 2000.0);
+                lmax = pow(10.0, max / 2000.0);
+                val = (lmax - lmin) * val + lmin;
+                *db = (int) lrint(2000.0 * log10(val));
+            }
+        }
+        return 0;
+
+    default:
+        return -EINVAL;
+    }
+}
+
+static struct mixer_ctl_db *mixer_ctl_build_db(const struct mixer_ctl *ctl)
+{
+    unsigned int buf[2 + MIXER_DB_TLV_WORDS];
+    struct snd_ctl_tlv *tlv = (struct snd_ctl_tlv *) buf;
+    const struct mixer_ctl_info *info = mixer_ctl_info(ctl);
+    struct mixer_ctl_db *db;
+    unsigned int count;
+    unsigned int n;
+    int prev;
+
+    if ((info->type != SNDRV_CTL_ELEM_TYPE_INTEGER) ||
+        !(info->access & SNDRV_CTL_ELEM_ACCESS_TLV_READ) ||
+        (info->value.integer.max < info->value.integer.min))
+        return NULL;
+
+    count = (unsigned int) ((long long) info->value.integer.max -
+                            info->value.integer.min + 1);
+    if (count > MIXER_DB_TABLE_MAX)
+        return NULL;
+
+    memset(buf, 0, sizeof(buf));
+    tlv->numid = ctl->numid;
+    tlv->length = MIXER_DB_TLV_WORDS * sizeof(unsigned int);
+    if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_TLV_READ, tlv) < 0)
+        return NULL;
+
+    db = malloc(sizeof(*db) + count * sizeof(db->centibel[0]));
+    if (!db)
+        return NULL;
+
+    db->min = info->value.integer.min;
+    db->count = count;
+    prev = MIXER_CTL_DB_MUTE;
+    for (n = 0; n < count; n++) {
+        if (mixer_tlv_to_db(tlv->tlv, MIXER_DB_TLV_WORDS,
+                            info->value.integer.min, info->value.integer.max,
+                            db->min + n, &db->centibel[n]) != 0) {
+            free(db);
+            return NULL;
+        }
+        /* lookups rely on the table being sorted */
+        if (db->centibel[n] < prev)
+            db->centibel[n] = prev;
+        prev = db->centibel[n];
+    }
+
+    return db;
+}
+
+/* Gets the dB table of a control, building it on first use.
+ * Threads that race here each build a table, the first one to publish it
+ * wins and the others free theirs.
+ */
+static const struct mixer_ctl_db *mixer_ctl_get_db_table(struct mixer_ctl *ctl)
+{
+    struct mixer_ctl_db *db;
+    struct mixer_ctl_db *expected = NULL;
+
+    db = __atomic_load_n(&ctl->db, __ATOMIC_ACQUIRE);
+    if (db)
+        return db;
+
+    db = mixer_ctl_build_db(ctl);
+    if (!db)
+        return NULL;
+
+    if (!__atomic_compare_exchange_n(&ctl->db, &expected, db, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(db);
+        return expected;
+    }
+    return db;
+}
+
+/* Finds the largest raw value whose gain does not exceed centibel,
+ * or the smallest raw value if all gains exceed it.
+ */
+static int mixer_db_to_value(const struct mixer_ctl_db *db, int centibel)
+{
+    unsigned int lo = 0;
+    unsigned int hi = db->count;
+    unsigned int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (db->centibel[mid] <= centibel)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return db->min + (lo ? lo - 1 : 0);
+}
+
+/* Finds the lowest audible gain of a control. Ramps interpolate between
+ * audible gains only, mute is just an end point. If every value mutes,
+ * the result is the mute value.
+ */
+static int mixer_db_lowest(const struct mixer_ctl_db *db)
+{
+    unsigned int n;
+
+    for (n = 0; n < db->count; n++)
+        if (db->centibel[n] != MIXER_CTL_DB_MUTE)
+            return db->centibel[n];
+
+    return MIXER_CTL_DB_MUTE;
+}
+
+/* Gets the lowest audible gain of a control with dB TLV data, for the
+ * ramps in mixer_ramp.c.
+ */
+int mixer_ctl_get_lowest_db(struct mixer_ctl *ctl, int *centibel)
+{
+    const struct mixer_ctl_db *db;
+
+    if (!ctl || !centibel)
         return -EINVAL;
 
-    return ctl->info.value.integer.max;
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db)
+        return -EINVAL;
+
+    *centibel = mixer_db_lowest(db);
+    return 0;
+}
+
+/** Converts a gain in dB to a raw value of a control.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param centibel The gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @returns On success, the largest raw value whose gain does not exceed
+ *  @p centibel, or the smallest raw value if all gains exceed it.
+ *  On failure, -EINVAL.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_db_to_value(struct mixer_ctl *ctl, int centibel)
+{
+    const struct mixer_ctl_db *db;
+
+    if (!ctl)
+        return -EINVAL;
+
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db)
+        return -EINVAL;
+
+    return mixer_db_to_value(db, centibel);
+}
+
+/** Converts a raw value of a control to a gain in dB.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param value The raw value.
+ * @param centibel Receives the gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @returns On success, zero.
+ *  On failure, -EINVAL.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_value_to_db(struct mixer_ctl *ctl, int value, int *centibel)
+{
+    const struct mixer_ctl_db *db;
+
+    if (!ctl || !centibel)
+        return -EINVAL;
+
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db || value < db->min || (unsigned int) (value - db->min) >= db->count)
+        return -EINVAL;
+
+    *centibel = db->centibel[value - db->min];
+    return 0;
+}
+
+/** Gets the gain of a control value in dB.
+ * The control's TLV data (DB_SCALE, DB_LINEAR, DB_MINMAX or DB_RANGE) is
+ * read once and turned into a table, so later calls cost a single read of
+ * the control.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param id The index of the value within the control.
+ * @param centibel Receives the gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_get_db(struct mixer_ctl *ctl, unsigned int id, int *centibel)
+{
+    const struct mixer_ctl_db *db;
+    int value;
+
+    if (!ctl || !centibel || (id >= mixer_ctl_info(ctl)->count))
+        return -EINVAL;
+
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db)
+        return -EINVAL;
+
+    value = mixer_ctl_get_value(ctl, id);
+    if (value < db->min || (unsigned int) (value - db->min) >= db->count)
+        return -EINVAL;
+
+    *centibel = db->centibel[value - db->min];
+    return 0;
+}
+
+/** Sets all values of a control to a gain in dB.
+ * The largest raw value whose gain does not exceed @p centibel is written to
+ * every value of the control with a single ioctl.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param centibel The gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_set_db(struct mixer_ctl *ctl, int centibel)
+{
+    const struct mixer_ctl_db *db;
+    int values[MIXER_CTL_INT_VALUES_MAX];
+    unsigned int count;
+    unsigned int n;
+    int value;
+
+    if (!ctl)
+        return -EINVAL;
+
+    count = mixer_ctl_info(ctl)->count;
+    if (!count || count > MIXER_CTL_INT_VALUES_MAX)
+        return -EINVAL;
+
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db)
+        return -EINVAL;
+
+    value = mixer_db_to_value(db, centibel);
+    for (n = 0; n < count; n++)
+        values[n] = value;
+
+    return mixer_ctl_set_values(ctl, values, count);
+}
+
+/** Ramps all values of a control to a gain in dB.
+ * The gain is moved in equal dB steps from the current gain of the first
+ * value to @p centibel over @p duration_ms milliseconds, writing the control
+ * only when the raw value changes. The function blocks until the ramp ends.
+ * A muted control ramps from its lowest gain.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param centibel The final gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @param duration_ms The duration of the ramp.
+ * @returns On success, zero.
+ *  On failure, non-zero.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ctl_ramp_db(struct mixer_ctl *ctl, int centibel,
+                      unsigned int duration_ms)
+{
+    const struct mixer_ctl_db *db;
+    struct timespec next;
+    long long interval;
+    unsigned int steps;
+    unsigned int step;
+    int lowest;
+    int start, end;
+    int target;
+    int current;
+    int value;
+    int ret;
+
+    if (!ctl)
+        return -EINVAL;
+
+    db = mixer_ctl_get_db_table(ctl);
+    if (!db)
+        return -EINVAL;
+
+    ret = mixer_ctl_get_db(ctl, 0, &start);
+    if (ret < 0)
+        return ret;
+
+    lowest = mixer_db_lowest(db);
+    end = centibel;
+    if (start < lowest)
+        start = lowest;
+    if (end < lowest)
+        end = lowest;
+
+    target = mixer_db_to_value(db, centibel);
+    current = mixer_db_to_value(db, start);
+    steps = abs(target - current);
+    if (steps > duration_ms)
+        steps = duration_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (step = 1; step < steps; step++) {
+        value = mixer_db_to_value(db, start + (int) (((long long) (end - start) *
+                                                      step) / steps));
+        if (value != current) {
+            ret = mixer_ctl_set_db(ctl, db->centibel[value - db->min]);
+            if (ret < 0)
+                return ret;
+            current = value;
+        }
+
+        interval = (long long) duration_ms * 1000000 / steps;
+        next.tv_sec += interval / 1000000000;
+        next.tv_nsec += interval % 1000000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+    }
+
+    return mixer_ctl_set_db(ctl, centibel);
 }
 
 /** Get the number of enumerated items in the control.
@@ -882,45 +2733,51 @@ unsigned int mixer_ctl_get_num_enums(const struct mixer_ctl *ctl)
     if (!ctl)
         return 0;
 
-    return ctl->info.value.enumerated.items;
+    return mixer_ctl_info(ctl)->value.items;
 }
 
-int mixer_ctl_fill_enum_string(struct mixer_ctl *ctl)
+/* Fills in the names of the enumerated items on first use and returns them.
+ * Threads that race here each build an array, the first one to publish it
+ * wins and the others free theirs. The array carries the count it was built
+ * with, so it stays consistent if the control is updated meanwhile.
+ */
+static struct mixer_enames *mixer_ctl_fill_enum_string(struct mixer_ctl *ctl)
 {
     struct snd_ctl_elem_info tmp;
-    unsigned int m;
-    char **enames;
+    struct mixer_enames *enames;
+    struct mixer_enames *expected = NULL;
+    unsigned int items, m;
 
-    if (ctl->ename) {
-        return 0;
-    }
+    enames = __atomic_load_n(&ctl->ename, __ATOMIC_ACQUIRE);
+    if (enames)
+        return enames;
 
-    enames = calloc(ctl->info.value.enumerated.items, sizeof(char*));
+    items = mixer_ctl_info(ctl)->value.items;
+    enames = calloc(1, sizeof(*enames) + items * sizeof(char*));
     if (!enames)
-        goto fail;
-    for (m = 0; m < ctl->info.value.enumerated.items; m++) {
+        return NULL;
+    enames->items = items;
+    for (m = 0; m < items; m++) {
         memset(&tmp, 0, sizeof(tmp));
-        tmp.id.numid = ctl->info.id.numid;
+        tmp.id.numid = ctl->numid;
         tmp.value.enumerated.item = m;
         if (ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_INFO, &tmp) < 0)
             goto fail;
-        enames[m] = strdup(tmp.value.enumerated.name);
-        if (!enames[m])
+        enames->names[m] = strdup(tmp.value.enumerated.name);
+        if (!enames->names[m])
             goto fail;
     }
-    ctl->ename = enames;
-    return 0;
 
-fail:
-    if (enames) {
-        for (m = 0; m < ctl->info.value.enumerated.items; m++) {
-            if (enames[m]) {
-                free(enames[m]);
-            }
-        }
-        free(enames);
+    if (!__atomic_compare_exchange_n(&ctl->ename, &expected, enames, 0,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        mixer_free_enames(enames);
+        return expected;
     }
-    return -1;
+    return enames;
+
+fail:
+    mixer_free_enames(enames);
+    return NULL;
 }
 
 /** Gets the string representation of an enumerated item.
@@ -932,12 +2789,16 @@ fail:
 const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl,
                                       unsigned int enum_id)
 {
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_ENUMERATED) ||
-        (enum_id >= ctl->info.value.enumerated.items) ||
-        mixer_ctl_fill_enum_string(ctl) != 0)
+    struct mixer_enames *ename;
+
+    if (!ctl || (mixer_ctl_info(ctl)->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED))
         return NULL;
 
-    return (const char *)ctl->ename[enum_id];
+    ename = mixer_ctl_fill_enum_string(ctl);
+    if (!ename || enum_id >= ename->items)
+        return NULL;
+
+    return (const char *)ename->names[enum_id];
 }
 
 /** Set an enumeration value by string value.
@@ -949,20 +2810,23 @@ const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl,
  */
 int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string)
 {
-    unsigned int i, num_enums;
+    unsigned int i;
     struct snd_ctl_elem_value ev;
+    struct mixer_enames *ename;
     int ret;
 
-    if (!ctl || (ctl->info.type != SNDRV_CTL_ELEM_TYPE_ENUMERATED) ||
-        mixer_ctl_fill_enum_string(ctl) != 0)
+    if (!ctl || (mixer_ctl_info(ctl)->type != SNDRV_CTL_ELEM_TYPE_ENUMERATED))
+        return -EINVAL;
+
+    ename = mixer_ctl_fill_enum_string(ctl);
+    if (!ename)
         return -EINVAL;
 
-    num_enums = ctl->info.value.enumerated.items;
-    for (i = 0; i < num_enums; i++) {
-        if (!strcmp(string, ctl->ename[i])) {
+    for (i = 0; i < ename->items; i++) {
+        if (!strcmp(string, ename->names[i])) {
             memset(&ev, 0, sizeof(ev));
             ev.value.enumerated.item[0] = i;
-            ev.id.numid = ctl->info.id.numid;
+            ev.id.numid = ctl->numid;
             ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
             if (ret < 0)
                 return ret;
@@ -973,3 +2837,204 @@ int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string)
     return -EINVAL;
 }
 
+
+/** A single value staged in a @ref mixer_transaction.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_transaction_change {
+    /** The control the value belongs to */
+    struct mixer_ctl *ctl;
+    /** The index of the value within the control */
+    unsigned int id;
+    /** The value to set */
+    int value;
+    /** The order in which the value was staged */
+    unsigned int seq;
+};
+
+/** A set of control values that are written together.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_transaction {
+    /** The mixer that the transaction belongs to */
+    struct mixer *mixer;
+    /** The staged values */
+    struct mixer_transaction_change *changes;
+    /** The number of staged values */
+    unsigned int count;
+    /** The number of values that fit in @ref changes */
+    unsigned int capacity;
+    /** The number of ioctls the last commit saved */
+    unsigned int ioctls_saved;
+};
+
+/** Begins a transaction of control writes.
+ * Values staged with @ref mixer_transaction_set_value are not written
+ * until @ref mixer_transaction_commit is called.
+ * @param mixer An initialized mixer handle.
+ * @returns On success, a transaction handle.
+ *  On failure, NULL.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_transaction *mixer_transaction_begin(struct mixer *mixer)
+{
+    struct mixer_transaction *transaction;
+
+    if (!mixer)
+        return NULL;
+
+    transaction = calloc(1, sizeof(*transaction));
+    if (!transaction)
+        return NULL;
+
+    transaction->mixer = mixer;
+    return transaction;
+}
+
+/** Frees a transaction, discarding any values that were not committed.
+ * @param transaction A transaction handle.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_transaction_free(struct mixer_transaction *transaction)
+{
+    if (!transaction)
+        return;
+
+    free(transaction->changes);
+    free(transaction);
+}
+
+/** Stages the value of a control, specified by the value index.
+ * The value is validated immediately, but only written by
+ * @ref mixer_transaction_commit. If the same value index is staged
+ * more than once, the last value wins.
+ * @param transaction A transaction handle.
+ * @param ctl A control that belongs to the transaction's mixer.
+ * @param id The index of the value within the control.
+ * @param value The value to set.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_transaction_set_value(struct mixer_transaction *transaction,
+                                struct mixer_ctl *ctl, unsigned int id,
+                                int value)
+{
+    struct mixer_transaction_change *change;
+    unsigned int capacity;
+
+    if (!transaction || !ctl || (ctl->mixer != transaction->mixer))
+        return -EINVAL;
+
+    if (mixer_ctl_check_value(mixer_ctl_info(ctl), id, value) != 0)
+        return -EINVAL;
+
+    if (transaction->count == transaction->capacity) {
+        capacity = transaction->capacity ? transaction->capacity * 2 : 32;
+        change = mixer_realloc_z(transaction->changes, transaction->capacity,
+                                 capacity, sizeof(*change));
+        if (!change)
+            return -ENOMEM;
+        transaction->changes = change;
+        transaction->capacity = capacity;
+    }
+
+    change = &transaction->changes[transaction->count];
+    change->ctl = ctl;
+    change->id = id;
+    change->value = value;
+    change->seq = transaction->count++;
+    return 0;
+}
+
+static int mixer_transaction_change_cmp(const void *a, const void *b)
+{
+    const struct mixer_transaction_change *ca = a;
+    const struct mixer_transaction_change *cb = b;
+
+    if (ca->ctl->numid != cb->ctl->numid)
+        return ca->ctl->numid < cb->ctl->numid ? -1 : 1;
+
+    return ca->seq < cb->seq ? -1 : (ca->seq > cb->seq);
+}
+
+/** Writes all staged values.
+ * Values are merged per control, so each control is read once and
+ * written at most once, no matter how many of its values were staged.
+ * Controls whose current values already match the staged values are
+ * not written at all.
+ * The transaction is empty afterwards and may be reused.
+ * @param transaction A transaction handle.
+ * @returns On success, zero.
+ *  On failure, a negative number. Controls are written in order of their
+ *  id, the controls before the failing one have already been written.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_transaction_commit(struct mixer_transaction *transaction)
+{
+    struct mixer_transaction_change *change;
+    struct mixer_ctl *ctl;
+    struct snd_ctl_elem_value ev;
+    struct snd_ctl_elem_value current;
+    unsigned int ioctls = 0;
+    unsigned int n, end;
+    int ret = 0;
+
+    if (!transaction)
+        return -EINVAL;
+
+    qsort(transaction->changes, transaction->count,
+          sizeof(*transaction->changes), mixer_transaction_change_cmp);
+
+    mixer_lock(transaction->mixer);
+
+    for (n = 0; n < transaction->count; n = end) {
+        ctl = transaction->changes[n].ctl;
+        for (end = n + 1; end < transaction->count; end++) {
+            if (transaction->changes[end].ctl != ctl)
+                break;
+        }
+
+        memset(&ev, 0, sizeof(ev));
+        ev.id.numid = ctl->numid;
+        ioctls++;
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_READ, &ev);
+        if (ret < 0)
+            break;
+
+        memcpy(&current, &ev, sizeof(current));
+        for (change = &transaction->changes[n];
+             change < &transaction->changes[end]; change++)
+            mixer_ctl_store_value(mixer_ctl_info(ctl), &ev, change->id,
+                                  change->value);
+
+        if (memcmp(&current, &ev, sizeof(ev)) == 0)
+            continue;
+
+        ioctls++;
+        ret = ioctl(ctl->mixer->fd, SNDRV_CTL_IOCTL_ELEM_WRITE, &ev);
+        if (ret < 0)
+            break;
+    }
+
+    mixer_unlock(transaction->mixer);
+
+    /* each staged value would have cost a read and a write on its own */
+    transaction->ioctls_saved = transaction->count * 2 - ioctls;
+    transaction->count = 0;
+    return ret;
+}
+
+/** Gets the number of ioctls the last commit saved, compared to setting
+ * every staged value with @ref mixer_ctl_set_value.
+ * @param transaction A transaction handle.
+ * @returns The number of ioctls saved by the last commit.
+ * @ingroup libtinyalsa-mixer
+ */
+unsigned int mixer_transaction_get_ioctls_saved(const struct mixer_transaction *transaction)
+{
+    if (!transaction)
+        return 0;
+
+    return transaction->ioctls_saved;
+}
@@ -0,0 +1,551 @@
+/* mixer_async.c
+**
+** Copyright 2011, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of The Android Open Source Project nor the names of
+**       its contributors may be used to endorse or promote products derived
+**       from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY The Android Open Source Project ``AS IS'' AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+** IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+** ARE DISCLAIMED. IN NO EVENT SHALL The Android Open Source Project BE LIABLE
+** FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+** DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+** SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+** CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+** LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+** OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+** DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <sys/eventfd.h>
+
+#include <tinyalsa/mixer.h>
+
+/* the number of requests the worker takes off the queue at once */
+#define MIXER_ASYNC_BATCH 64
+
+#define MIXER_ASYNC_VALUE 0
+#define MIXER_ASYNC_ARRAY 1
+
+/** A queued control write.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_async_request {
+    /** Sequence number used to hand the slot between producers and the worker */
+    atomic_uint seq;
+    /** Either MIXER_ASYNC_VALUE or MIXER_ASYNC_ARRAY */
+    int type;
+    /** The control to write */
+    struct mixer_ctl *ctl;
+    /** The index of the value, for value requests */
+    unsigned int id;
+    /** The value, for value requests */
+    int value;
+    /** The number of items in @ref data, for array requests */
+    size_t count;
+    /** The payload of array requests, preallocated when the queue is opened */
+    unsigned char *data;
+};
+
+/** A queue of control writes serviced by a worker thread.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_async {
+    /** The mixer that the queue writes to */
+    struct mixer *mixer;
+    /** The request slots, a power of two in number */
+    struct mixer_async_request *requests;
+    /** The number of slots minus one */
+    unsigned int mask;
+    /** The payload storage of all slots */
+    unsigned char *payload;
+    /** The size of each slot's payload */
+    size_t payload_size;
+    /** The position of the next request to queue */
+    atomic_uint enqueue_pos;
+    /** The position of the next request the worker services */
+    unsigned int dequeue_pos;
+    /** Set while the worker waits for requests */
+    atomic_int sleeping;
+    /** Set to stop the worker */
+    atomic_int stop;
+    /** Wakes the worker */
+    int wake_fd;
+    /** Signalled whenever the worker completed requests */
+    int done_fd;
+    /** The number of completed requests */
+    atomic_uint completed;
+    /** The number of requests that failed */
+    atomic_uint failed;
+    /** The error of the last request that failed */
+    atomic_int last_error;
+    /** The worker thread */
+    pthread_t thread;
+    /** The transaction used to merge value requests */
+    struct mixer_transaction *transaction;
+};
+
+static size_t mixer_async_item_size(const struct mixer_ctl *ctl)
+{
+    switch (mixer_ctl_get_type(ctl)) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+        return sizeof(long);
+    case MIXER_CTL_TYPE_BYTE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void mixer_async_wake(struct mixer_async *async)
+{
+    uint64_t one = 1;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&async->sleeping, 0)) {
+        if (write(async->wake_fd, &one, sizeof(one)) < 0) {
+            /* the counter can only be saturated if the worker is awake */
+        }
+    }
+}
+
+/* Reserves a slot, lock and allocation free. This is the bounded queue
+ * by Dmitry Vyukov: each slot's sequence number tells whether it is free
+ * for the producer that claims position pos.
+ */
+static struct mixer_async_request *mixer_async_reserve(struct mixer_async *async,
+                                                       unsigned int *pos)
+{
+    struct mixer_async_request *request;
+    unsigned int seq;
+    int diff;
+
+    *pos = atomic_load_explicit(&async->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        request = &async->requests[*pos & async->mask];
+        seq = atomic_load_explicit(&request->seq, memory_order_acquire);
+        diff = (int) (seq - *pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&async->enqueue_pos,
+                                                      pos, *pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                return request;
+        } else if (diff < 0) {
+            return NULL; /* full */
+        } else {
+            *pos = atomic_load_explicit(&async->enqueue_pos,
+                                        memory_order_relaxed);
+        }
+    }
+}
+
+static void mixer_async_publish(struct mixer_async *async,
+                                struct mixer_async_request *request,
+                                unsigned int pos)
+{
+    atomic_store_explicit(&request->seq, pos + 1, memory_order_release);
+    mixer_async_wake(async);
+}
+
+/** Queues a write of a control value, specified by the value index.
+ * This function does not block, does not allocate memory and does not
+ * call into the kernel unless the worker thread is asleep, in which case
+ * it is woken with a write to an eventfd. It may be called from real-time
+ * threads and from several threads at once.
+ * Queued writes to the same control are merged, so that only the latest
+ * values are written.
+ * @param async A queue returned by @ref mixer_async_open.
+ * @param ctl An initialized control handle.
+ * @param id The index of the value within the control.
+ * @param value The value to set.
+ * @returns On success, zero.
+ *  If the queue is full, -EAGAIN.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_async_set_value(struct mixer_async *async, struct mixer_ctl *ctl,
+                          unsigned int id, int value)
+{
+    struct mixer_async_request *request;
+    unsigned int pos;
+
+    if (!async || !ctl)
+        return -EINVAL;
+
+    request = mixer_async_reserve(async, &pos);
+    if (!request)
+        return -EAGAIN;
+
+    request->type = MIXER_ASYNC_VALUE;
+    request->ctl = ctl;
+    request->id = id;
+    request->value = value;
+    mixer_async_publish(async, request, pos);
+    return 0;
+}
+
+/** Queues a write of a control's value array.
+ * The array is copied into storage that was allocated by
+ * @ref mixer_async_open, see @ref mixer_async_set_value for the
+ * guarantees of this function.
+ * A queued array write replaces all writes to the same control that were
+ * queued before it and not yet serviced.
+ * @param async A queue returned by @ref mixer_async_open.
+ * @param ctl An initialized control handle.
+ * @param array The array containing control values, as for @ref mixer_ctl_set_array.
+ * @param count The number of values in the array, as for @ref mixer_ctl_set_array.
+ * @returns On success, zero.
+ *  If the queue is full, -EAGAIN.
+ *  If the array is larger than the queue's maximum array size, -E2BIG.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_async_set_array(struct mixer_async *async, struct mixer_ctl *ctl,
+                          const void *array, size_t count)
+{
+    struct mixer_async_request *request;
+    unsigned int pos;
+    size_t item_size;
+
+    if (!async || !ctl || !array || !count)
+        return -EINVAL;
+
+    item_size = mixer_async_item_size(ctl);
+    if (!item_size)
+        return -EINVAL;
+
+    if (count > async->payload_size / item_size)
+        return -E2BIG;
+
+    request = mixer_async_reserve(async, &pos);
+    if (!request)
+        return -EAGAIN;
+
+    request->type = MIXER_ASYNC_ARRAY;
+    request->ctl = ctl;
+    request->count = count;
+    memcpy(request->data, array, count * item_size);
+    mixer_async_publish(async, request, pos);
+    return 0;
+}
+
+static void mixer_async_fail(struct mixer_async *async, int error)
+{
+    atomic_fetch_add(&async->failed, 1);
+    atomic_store(&async->last_error, error);
+}
+
+/* Services a batch of requests. A request is skipped if a later array
+ * request of the batch writes the same control. The remaining array
+ * requests are written first, then all value requests are merged into a
+ * single transaction, which writes each control at most once.
+ */
+static void mixer_async_service(struct mixer_async *async,
+                                struct mixer_async_request **batch,
+                                unsigned int count)
+{
+    struct mixer_async_request *request;
+    unsigned int i, j;
+    int superseded;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        request = batch[i];
+        superseded = 0;
+        for (j = i + 1; j < count; j++) {
+            if (batch[j]->ctl == request->ctl &&
+                batch[j]->type == MIXER_ASYNC_ARRAY) {
+                superseded = 1;
+                break;
+            }
+        }
+        if (superseded) {
+            batch[i] = NULL;
+            continue;
+        }
+
+        if (request->type == MIXER_ASYNC_ARRAY) {
+            ret = mixer_ctl_set_array(request->ctl, request->data,
+                                      request->count);
+            if (ret < 0)
+                mixer_async_fail(async, ret);
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        request = batch[i];
+        if (!request || request->type != MIXER_ASYNC_VALUE)
+            continue;
+        ret = mixer_transaction_set_value(async->transaction, request->ctl,
+                                          request->id, request->value);
+        if (ret < 0)
+            mixer_async_fail(async, ret);
+    }
+
+    ret = mixer_transaction_commit(async->transaction);
+    if (ret < 0)
+        mixer_async_fail(async, ret);
+}
+
+static unsigned int mixer_async_drain(struct mixer_async *async)
+{
+    struct mixer_async_request *batch[MIXER_ASYNC_BATCH];
+    struct mixer_async_request *request;
+    uint64_t done;
+    unsigned int count;
+    unsigned int n;
+
+    for (count = 0; count < MIXER_ASYNC_BATCH; count++) {
+        request = &async->requests[(async->dequeue_pos + count) & async->mask];
+        if (atomic_load_explicit(&request->seq, memory_order_acquire) !=
+            async->dequeue_pos + count + 1)
+            break;
+        batch[count] = request;
+    }
+
+    if (!count)
+        return 0;
+
+    mixer_async_service(async, batch, count);
+
+    /* hand the slots back to the producers */
+    for (n = 0; n < count; n++) {
+        request = &async->requests[async->dequeue_pos & async->mask];
+        atomic_store_explicit(&request->seq,
+                              async->dequeue_pos + async->mask + 1,
+                              memory_order_release);
+        async->dequeue_pos++;
+    }
+
+    atomic_fetch_add(&async->completed, count);
+    done = count;
+    if (write(async->done_fd, &done, sizeof(done)) < 0) {
+        /* nobody reads the completion counter, that is fine */
+    }
+
+    return count;
+}
+
+static int mixer_async_is_empty(struct mixer_async *async)
+{
+    struct mixer_async_request *request;
+
+    request = &async->requests[async->dequeue_pos & async->mask];
+    return atomic_load_explicit(&request->seq, memory_order_acquire) !=
+           async->dequeue_pos + 1;
+}
+
+static void *mixer_async_worker(void *data)
+{
+    struct mixer_async *async = data;
+    struct pollfd pfd;
+    uint64_t wakeups;
+
+    pfd.fd = async->wake_fd;
+    pfd.events = POLLIN;
+
+    while (!atomic_load(&async->stop)) {
+        if (mixer_async_drain(async))
+            continue;
+
+        atomic_store(&async->sleeping, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!mixer_async_is_empty(async) || atomic_load(&async->stop)) {
+            atomic_store(&async->sleeping, 0);
+            continue;
+        }
+
+        if (poll(&pfd, 1, -1) > 0) {
+            if (read(async->wake_fd, &wakeups, sizeof(wakeups)) < 0) {
+                /* spurious wakeup, the queue is checked again anyway */
+            }
+        }
+        atomic_store(&async->sleeping, 0);
+    }
+
+    /* service what is left before exiting */
+    while (mixer_async_drain(async))
+        ;
+
+    return NULL;
+}
+
+/** Opens a queue of control writes for a mixer.
+ * All memory that is needed to queue writes is allocated here, and a worker
+ * thread is started that performs the writes. The mixer must outlive the
+ * queue, and must not be used by other threads at the same time unless its
+ * functions are known to be safe to call concurrently.
+ * @param mixer An initialized mixer handle.
+ * @param queue_size The number of writes that can be queued,
+ *  rounded up to a power of two.
+ * @param max_array_size The size in bytes of the largest array that can be
+ *  queued with @ref mixer_async_set_array. May be zero.
+ * @returns On success, a queue handle.
+ *  On failure, NULL.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_async *mixer_async_open(struct mixer *mixer,
+                                     unsigned int queue_size,
+                                     size_t max_array_size)
+{
+    struct mixer_async *async;
+    unsigned int size = 1;
+    unsigned int n;
+
+    if (!mixer || !queue_size || queue_size > (UINT32_MAX >> 2))
+        return NULL;
+
+    while (size < queue_size)
+        size <<= 1;
+
+    async = calloc(1, sizeof(*async));
+    if (!async)
+        return NULL;
+
+    async->mixer = mixer;
+    async->mask = size - 1;
+    async->payload_size = max_array_size;
+    async->wake_fd = -1;
+    async->done_fd = -1;
+
+    async->requests = calloc(size, sizeof(*async->requests));
+    if (!async->requests)
+        goto fail;
+
+    if (max_array_size) {
+        async->payload = calloc(size, max_array_size);
+        if (!async->payload)
+            goto fail;
+    }
+
+    for (n = 0; n < size; n++) {
+        atomic_init(&async->requests[n].seq, n);
+        if (async->payload)
+            async->requests[n].data = async->payload + n * max_array_size;
+    }
+
+    async->transaction = mixer_transaction_begin(mixer);
+    if (!async->transaction)
+        goto fail;
+
+    async->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    async->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (async->wake_fd < 0 || async->done_fd < 0)
+        goto fail;
+
+    if (pthread_create(&async->thread, NULL, mixer_async_worker, async) != 0)
+        goto fail;
+
+    return async;
+
+fail:
+    if (async->wake_fd >= 0)
+        close(async->wake_fd);
+    if (async->done_fd >= 0)
+        close(async->done_fd);
+    mixer_transaction_free(async->transaction);
+    free(async->payload);
+    free(async->requests);
+    free(async);
+    return NULL;
+}
+
+/** Closes a queue returned by @ref mixer_async_open.
+ * Writes that are still queued are performed before this function returns.
+ * @param async A queue handle.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_async_close(struct mixer_async *async)
+{
+    uint64_t one = 1;
+
+    if (!async)
+        return;
+
+    atomic_store(&async->stop, 1);
+    if (write(async->wake_fd, &one, sizeof(one)) < 0) {
+        /* the worker is awake already */
+    }
+    pthread_join(async->thread, NULL);
+
+    close(async->wake_fd);
+    close(async->done_fd);
+    mixer_transaction_free(async->transaction);
+    free(async->payload);
+    free(async->requests);
+    free(async);
+}
+
+/** Gets a file descriptor that becomes readable when queued writes complete.
+ * The file descriptor is an eventfd. Reading it returns the number of
+ * requests completed since the last read and resets it.
+ * @param async A queue handle.
+ * @returns The file descriptor, owned by the queue.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_async_get_fd(const struct mixer_async *async)
+{
+    if (!async)
+        return -1;
+
+    return async->done_fd;
+}
+
+/** Gets the number of queued writes that have completed.
+ * A write counts as completed once it was performed or merged into a later
+ * write. The counter wraps around, compare it to the number of writes
+ * queued to find out whether a write has completed.
+ * This function is cheap and never blocks.
+ * @param async A queue handle.
+ * @returns The number of completed writes.
+ * @ingroup libtinyalsa-mixer
+ */
+unsigned int mixer_async_get_completed(const struct mixer_async *async)
+{
+    if (!async)
+        return 0;
+
+    return atomic_load(&((struct mixer_async *)async)->completed);
+}
+
+/** Gets the number of queued writes that failed, and the error of the
+ * last failure.
+ * @param async A queue handle.
+ * @param last_error If not NULL, receives the (negative) error of the last
+ *  failed write, or zero.
+ * @returns The number of writes that failed.
+ * @ingroup libtinyalsa-mixer
+ */
+unsigned int mixer_async_get_failed(const struct mixer_async *async,
+                                    int *last_error)
+{
+    struct mixer_async *a = (struct mixer_async *)async;
+
+    if (!async)
+        return 0;
+
+    if (last_error)
+        *last_error = atomic_load(&a->last_error);
+
+    return atomic_load(&a->failed);
+}
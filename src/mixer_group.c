@@ -0,0 +1,610 @@
+/* mixer_group.c
+**
+** Copyright 2011, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of The Android Open Source Project nor the names of
+**       its contributors may be used to endorse or promote products derived
+**       from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY The Android Open Source Project ``AS IS'' AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+** IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+** ARE DISCLAIMED. IN NO EVENT SHALL The Android Open Source Project BE LIABLE
+** FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+** DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+** SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+** CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+** LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+** OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+** DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+
+#include <sys/epoll.h>
+
+#include <tinyalsa/mixer.h>
+
+/* the number of epoll and mixer events handled at once */
+#define MIXER_GROUP_BATCH 16
+
+/** A callback registered for a control.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_group_handler {
+    /** The function to call, or NULL */
+    mixer_group_callback callback;
+    /** The user data passed to @ref callback */
+    void *data;
+};
+
+/** The mixer of one card in a group.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_group_member {
+    /** The card number */
+    unsigned int card;
+    /** The mixer of the card */
+    struct mixer *mixer;
+    /** The number of controls when the group was opened */
+    unsigned int num_ctls;
+    /** The handlers of the controls, indexed by control id */
+    struct mixer_group_handler *handlers;
+    /** The error that stopped the events of the card, or zero */
+    int error;
+};
+
+/** An entry of the (card, name, index) index.
+ * The name is not stored, it is compared through the control.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_group_entry {
+    /** The hash of the card and the name */
+    unsigned int hash;
+    /** The index of the member plus one, zero for an empty entry */
+    unsigned int member;
+    /** The id of the control within the member's mixer */
+    unsigned int id;
+    /** The index of the control among controls of the same name */
+    unsigned int index;
+};
+
+/** The mixers of all cards of the system.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_group {
+    /** The members, sorted by card number */
+    struct mixer_group_member *members;
+    /** The number of members */
+    unsigned int num_members;
+    /** The open addressed (card, name, index) index */
+    struct mixer_group_entry *entries;
+    /** The number of entries minus one */
+    unsigned int mask;
+    /** The epoll instance that waits on all control devices */
+    int epoll_fd;
+    /** The handler for controls without a handler of their own */
+    struct mixer_group_handler fallback;
+};
+
+static unsigned int mixer_group_hash(unsigned int card, const char *name)
+{
+    /* FNV-1a */
+    unsigned int hash = 2166136261u ^ card;
+
+    while (*name) {
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int mixer_group_member_cmp(const void *a, const void *b)
+{
+    const struct mixer_group_member *ma = a;
+    const struct mixer_group_member *mb = b;
+
+    if (ma->card != mb->card)
+        return ma->card < mb->card ? -1 : 1;
+    return 0;
+}
+
+static void *mixer_group_open_member(void *arg)
+{
+    struct mixer_group_member *member = arg;
+
+    member->mixer = mixer_open(member->card);
+    if (member->mixer && mixer_subscribe_events(member->mixer, 1) != 0) {
+        mixer_close(member->mixer);
+        member->mixer = NULL;
+    }
+
+    return NULL;
+}
+
+/* Opens the mixers of all cards, one thread per card, so that the element
+ * enumeration of slow devices (e.g. USB) does not delay the others.
+ */
+static int mixer_group_open_members(struct mixer_group *group)
+{
+    struct mixer_group_member *members = NULL;
+    struct mixer_group_member *tmp;
+    pthread_t *threads = NULL;
+    char *started = NULL;
+    unsigned int count = 0;
+    unsigned int size = 0;
+    unsigned int card;
+    unsigned int n;
+    struct dirent *entry;
+    DIR *dir;
+    char c;
+
+    dir = opendir("/dev/snd");
+    if (!dir)
+        return -1;
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "controlC%u%c", &card, &c) != 1)
+            continue;
+        if (count == size) {
+            size = size ? size * 2 : 8;
+            tmp = realloc(members, size * sizeof(*members));
+            if (!tmp)
+                goto fail;
+            members = tmp;
+        }
+        memset(&members[count], 0, sizeof(members[count]));
+        members[count++].card = card;
+    }
+    closedir(dir);
+    dir = NULL;
+
+    if (!count)
+        goto fail;
+
+    threads = calloc(count, sizeof(*threads));
+    started = calloc(count, sizeof(*started));
+    if (!threads || !started)
+        goto fail;
+
+    for (n = 0; n < count; n++) {
+        if (pthread_create(&threads[n], NULL, mixer_group_open_member,
+                           &members[n]) == 0)
+            started[n] = 1;
+        else
+            mixer_group_open_member(&members[n]);
+    }
+    for (n = 0; n < count; n++)
+        if (started[n])
+            pthread_join(threads[n], NULL);
+
+    /* drop the cards that could not be opened */
+    size = 0;
+    for (n = 0; n < count; n++)
+        if (members[n].mixer)
+            members[size++] = members[n];
+
+    if (!size)
+        goto fail;
+
+    qsort(members, size, sizeof(*members), mixer_group_member_cmp);
+    for (n = 0; n < size; n++)
+        members[n].num_ctls = mixer_get_num_ctls(members[n].mixer);
+
+    group->members = members;
+    group->num_members = size;
+    free(started);
+    free(threads);
+    return 0;
+
+fail:
+    if (dir)
+        closedir(dir);
+    free(started);
+    free(threads);
+    free(members);
+    return -1;
+}
+
+static int mixer_group_build_index(struct mixer_group *group)
+{
+    const struct mixer_group_member *member;
+    struct mixer_group_entry *entry;
+    const char *name;
+    unsigned int total = 0;
+    unsigned int size = 16;
+    unsigned int hash;
+    unsigned int pos;
+    unsigned int m;
+    unsigned int n;
+    unsigned int i;
+
+    for (m = 0; m < group->num_members; m++)
+        total += group->members[m].num_ctls;
+
+    /* keep the load factor at or below one half */
+    while (size < total * 2)
+        size <<= 1;
+
+    group->entries = calloc(size, sizeof(*group->entries));
+    if (!group->entries)
+        return -1;
+    group->mask = size - 1;
+
+    for (m = 0; m < group->num_members; m++) {
+        member = &group->members[m];
+        for (n = 0; n < member->num_ctls; n++) {
+            name = mixer_ctl_get_name(mixer_get_ctl(member->mixer, n));
+            hash = mixer_group_hash(member->card, name);
+            /* controls of the same name share a probe sequence, and are
+             * inserted in id order, so their index is the number of
+             * entries of the same name that precede them */
+            i = 0;
+            for (pos = hash & group->mask; group->entries[pos].member;
+                 pos = (pos + 1) & group->mask) {
+                entry = &group->entries[pos];
+                if (entry->hash == hash && entry->member == m + 1 &&
+                    !strcmp(name, mixer_ctl_get_name(
+                                      mixer_get_ctl(member->mixer, entry->id))))
+                    i++;
+            }
+            entry = &group->entries[pos];
+            entry->hash = hash;
+            entry->member = m + 1;
+            entry->id = n;
+            entry->index = i;
+        }
+    }
+
+    return 0;
+}
+
+/** Opens the mixers of all sound cards.
+ * The mixers are opened in parallel, subscribed to events, and indexed by
+ * card number, control name and control index. Events of all mixers are
+ * waited on with a single epoll instance, see @ref mixer_group_dispatch.
+ * Cards that cannot be opened are left out of the group.
+ * @returns On success, a group handle.
+ *  On failure (including when no card could be opened), NULL.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_group *mixer_group_open(void)
+{
+    struct mixer_group *group;
+    struct mixer_group_member *member;
+    struct epoll_event ev;
+    unsigned int n;
+
+    group = calloc(1, sizeof(*group));
+    if (!group)
+        return NULL;
+
+    group->epoll_fd = -1;
+
+    if (mixer_group_open_members(group) != 0) {
+        free(group);
+        return NULL;
+    }
+
+    if (mixer_group_build_index(group) != 0)
+        goto fail;
+
+    for (n = 0; n < group->num_members; n++) {
+        member = &group->members[n];
+        member->handlers = calloc(member->num_ctls ? member->num_ctls : 1,
+                                  sizeof(*member->handlers));
+        if (!member->handlers)
+            goto fail;
+    }
+
+    group->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (group->epoll_fd < 0)
+        goto fail;
+
+    for (n = 0; n < group->num_members; n++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = n;
+        if (epoll_ctl(group->epoll_fd, EPOLL_CTL_ADD,
+                      mixer_get_file_descriptor(group->members[n].mixer),
+                      &ev) < 0)
+            goto fail;
+    }
+
+    return group;
+
+fail:
+    mixer_group_close(group);
+    return NULL;
+}
+
+/** Closes a group and the mixers in it.
+ * @param group A group handle returned by @ref mixer_group_open.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_group_close(struct mixer_group *group)
+{
+    unsigned int n;
+
+    if (!group)
+        return;
+
+    if (group->epoll_fd >= 0)
+        close(group->epoll_fd);
+
+    for (n = 0; n < group->num_members; n++) {
+        mixer_close(group->members[n].mixer);
+        free(group->members[n].handlers);
+    }
+
+    free(group->entries);
+    free(group->members);
+    free(group);
+}
+
+/** Gets the number of mixers in a group.
+ * @param group A group handle.
+ * @returns The number of cards that were opened.
+ * @ingroup libtinyalsa-mixer
+ */
+unsigned int mixer_group_get_num_mixers(const struct mixer_group *group)
+{
+    if (!group)
+        return 0;
+
+    return group->num_members;
+}
+
+static struct mixer_group_member *mixer_group_find_member(struct mixer_group *group,
+                                                          unsigned int card)
+{
+    unsigned int lo = 0;
+    unsigned int hi = group->num_members;
+    unsigned int mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (group->members[mid].card == card)
+            return &group->members[mid];
+        if (group->members[mid].card < card)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+/** Gets the mixer of a card in a group.
+ * The mixer is owned by the group.
+ * @param group A group handle.
+ * @param card The card number.
+ * @returns The mixer of the card, or NULL if the card is not in the group.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer *mixer_group_get_mixer(struct mixer_group *group,
+                                    unsigned int card)
+{
+    struct mixer_group_member *member;
+
+    if (!group)
+        return NULL;
+
+    member = mixer_group_find_member(group, card);
+    return member ? member->mixer : NULL;
+}
+
+/** Gets a control by card number, name and index.
+ * This is the group wide equivalent of
+ * @ref mixer_get_ctl_by_name_and_index, answered from a hash index instead
+ * of a scan of the controls. Only controls that existed when the group was
+ * opened are indexed.
+ * @param group A group handle.
+ * @param card The card number.
+ * @param name The name of the control.
+ * @param index The index among controls with the same name.
+ * @returns The control, or NULL if it was not found.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ctl *mixer_group_get_ctl(struct mixer_group *group,
+                                      unsigned int card, const char *name,
+                                      unsigned int index)
+{
+    const struct mixer_group_entry *entry;
+    struct mixer_ctl *ctl;
+    unsigned int hash;
+    unsigned int pos;
+
+    if (!group || !name)
+        return NULL;
+
+    hash = mixer_group_hash(card, name);
+    for (pos = hash & group->mask; group->entries[pos].member;
+         pos = (pos + 1) & group->mask) {
+        entry = &group->entries[pos];
+        if (entry->hash != hash || entry->index != index ||
+            group->members[entry->member - 1].card != card)
+            continue;
+        ctl = mixer_get_ctl(group->members[entry->member - 1].mixer, entry->id);
+        if (ctl && !strcmp(name, mixer_ctl_get_name(ctl)))
+            return ctl;
+    }
+
+    return NULL;
+}
+
+/** Registers a callback for the events of a control.
+ * @param group A group handle.
+ * @param ctl A control of one of the group's mixers, or NULL to set the
+ *  callback for all events that have no callback of their own, which
+ *  includes events of controls added after the group was opened.
+ * @param callback The function to call, or NULL to remove the callback.
+ * @param data User data passed to @p callback.
+ * @returns On success, zero.
+ *  On failure, -EINVAL.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_group_set_callback(struct mixer_group *group, struct mixer_ctl *ctl,
+                             mixer_group_callback callback, void *data)
+{
+    struct mixer_group_member *member;
+    unsigned int id;
+    unsigned int n;
+
+    if (!group)
+        return -EINVAL;
+
+    if (!ctl) {
+        group->fallback.callback = callback;
+        group->fallback.data = data;
+        return 0;
+    }
+
+    id = mixer_ctl_get_id(ctl);
+    for (n = 0; n < group->num_members; n++) {
+        member = &group->members[n];
+        if (id < member->num_ctls && mixer_get_ctl(member->mixer, id) == ctl) {
+            member->handlers[id].callback = callback;
+            member->handlers[id].data = data;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+/** Gets the epoll file descriptor of a group.
+ * It becomes readable when any mixer of the group has pending events,
+ * so it can be added to an outer event loop that then calls
+ * @ref mixer_group_dispatch with a timeout of zero.
+ * @param group A group handle.
+ * @returns The file descriptor, owned by the group.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_group_get_fd(const struct mixer_group *group)
+{
+    if (!group)
+        return -1;
+
+    return group->epoll_fd;
+}
+
+static int mixer_group_dispatch_member(struct mixer_group *group,
+                                       struct mixer_group_member *member)
+{
+    struct mixer_ctl_event events[MIXER_GROUP_BATCH];
+    const struct mixer_group_handler *handler;
+    int count;
+    int n;
+
+    count = mixer_read_event(member->mixer, events, MIXER_GROUP_BATCH);
+    if (count < 0)
+        return count;
+
+    for (n = 0; n < count; n++) {
+        handler = &group->fallback;
+        if (events[n].ctl && events[n].id < member->num_ctls &&
+            member->handlers[events[n].id].callback)
+            handler = &member->handlers[events[n].id];
+        if (handler->callback)
+            handler->callback(group, member->mixer, &events[n], handler->data);
+    }
+
+    return count;
+}
+
+/* Stops waiting on a card whose control device failed, so that the other
+ * cards of the group keep being dispatched.
+ */
+static void mixer_group_fail_member(struct mixer_group *group,
+                                    struct mixer_group_member *member,
+                                    int error)
+{
+    member->error = error;
+    epoll_ctl(group->epoll_fd, EPOLL_CTL_DEL,
+              mixer_get_file_descriptor(member->mixer), NULL);
+}
+
+/** Waits for events on all mixers of a group and dispatches them.
+ * Each event is passed to the callback of its control, or to the fallback
+ * callback. Callbacks are called from the thread that calls this function.
+ * A card whose control device fails does not stop the others: its error is
+ * recorded, see @ref mixer_group_get_error, it is no longer waited on, and
+ * the events of the other cards are still dispatched.
+ * @param group A group handle.
+ * @param timeout The time to wait in milliseconds, -1 to wait forever.
+ * @returns On success, the number of events dispatched (which is zero on
+ *  timeout).
+ *  On failure to wait, -errno.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_group_dispatch(struct mixer_group *group, int timeout)
+{
+    struct epoll_event ev[MIXER_GROUP_BATCH];
+    struct mixer_group_member *member;
+    int total = 0;
+    int count;
+    int ret;
+    int n;
+
+    if (!group)
+        return -EINVAL;
+
+    do {
+        count = epoll_wait(group->epoll_fd, ev, MIXER_GROUP_BATCH, timeout);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0)
+        return -errno;
+
+    for (n = 0; n < count; n++) {
+        if (ev[n].data.u32 >= group->num_members)
+            continue;
+        member = &group->members[ev[n].data.u32];
+        if (ev[n].events & (EPOLLERR | EPOLLHUP)) {
+            mixer_group_fail_member(group, member, -EIO);
+            continue;
+        }
+        ret = mixer_group_dispatch_member(group, member);
+        if (ret < 0) {
+            mixer_group_fail_member(group, member, ret);
+            continue;
+        }
+        total += ret;
+    }
+
+    return total;
+}
+
+/** Gets the error that stopped the events of a card in a group.
+ * @param group A group handle.
+ * @param card The card number.
+ * @returns Zero if the events of the card are dispatched, the (negative)
+ *  error if its control device failed in @ref mixer_group_dispatch, or
+ *  -EINVAL if the card is not in the group.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_group_get_error(const struct mixer_group *group, unsigned int card)
+{
+    struct mixer_group_member *member;
+
+    if (!group)
+        return -EINVAL;
+
+    member = mixer_group_find_member((struct mixer_group *)group, card);
+    return member ? member->error : -EINVAL;
+}
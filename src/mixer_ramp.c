@@ -0,0 +1,467 @@
+/* mixer_ramp.c
+**
+** Copyright 2011, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of The Android Open Source Project nor the names of
+**       its contributors may be used to endorse or promote products derived
+**       from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY The Android Open Source Project ``AS IS'' AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+** IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+** ARE DISCLAIMED. IN NO EVENT SHALL The Android Open Source Project BE LIABLE
+** FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+** DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+** SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+** CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+** LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+** OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+** DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <tinyalsa/mixer.h>
+
+#include "mixer_internal.h"
+
+/** A ramp of one control towards a target.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ramp_entry {
+    /** The control being ramped */
+    struct mixer_ctl *ctl;
+    /** Non-zero if the ramp moves in dB rather than in raw values */
+    int db;
+    /** The number of values of the control */
+    unsigned int count;
+    /** The raw values when the ramp started, or the gain in [0] for dB ramps */
+    int start[MIXER_CTL_INT_VALUES_MAX];
+    /** The values written last */
+    int current[MIXER_CTL_INT_VALUES_MAX];
+    /** The raw target, or the gain that dB ramps interpolate towards */
+    int end;
+    /** The raw value written when the ramp ends */
+    int final;
+    /** When the ramp started, in nanoseconds of CLOCK_MONOTONIC */
+    int64_t start_ns;
+    /** The duration of the ramp in nanoseconds */
+    int64_t duration_ns;
+};
+
+/** Runs ramps of controls of any number of mixers on one worker thread.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ramp {
+    /** Protects the ramps */
+    pthread_mutex_t lock;
+    /** The active ramps */
+    struct mixer_ramp_entry *entries;
+    /** The number of active ramps */
+    unsigned int count;
+    /** The number of ramps that fit in @ref entries */
+    unsigned int capacity;
+    /** The time between two steps of a ramp */
+    unsigned int step_ms;
+    /** Fires every step while ramps are active */
+    int timer_fd;
+    /** Stops the worker */
+    int stop_fd;
+    /** The worker thread */
+    pthread_t thread;
+};
+
+static int64_t mixer_ramp_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void mixer_ramp_arm(struct mixer_ramp *ramp, int enable)
+{
+    struct itimerspec its;
+
+    memset(&its, 0, sizeof(its));
+    if (enable) {
+        its.it_interval.tv_sec = ramp->step_ms / 1000;
+        its.it_interval.tv_nsec = (long) (ramp->step_ms % 1000) * 1000000;
+        its.it_value = its.it_interval;
+    }
+    timerfd_settime(ramp->timer_fd, 0, &its, NULL);
+}
+
+static void mixer_ramp_remove(struct mixer_ramp *ramp, unsigned int n)
+{
+    ramp->count--;
+    if (n != ramp->count)
+        ramp->entries[n] = ramp->entries[ramp->count];
+    if (!ramp->count)
+        mixer_ramp_arm(ramp, 0);
+}
+
+/* Computes the values of a ramp at a point in time.
+ * Returns non-zero when the ramp has ended.
+ */
+static int mixer_ramp_values(struct mixer_ramp_entry *entry, int64_t now,
+                             int *values)
+{
+    /* in microseconds, so that the products below cannot overflow */
+    int64_t elapsed = (now - entry->start_ns) / 1000;
+    int64_t duration = entry->duration_ns / 1000;
+    unsigned int n;
+    int value;
+
+    if (elapsed >= duration) {
+        for (n = 0; n < entry->count; n++)
+            values[n] = entry->final;
+        return 1;
+    }
+
+    if (entry->db) {
+        value = entry->start[0] + (int) (((int64_t) entry->end - entry->start[0]) *
+                                         elapsed / duration);
+        value = mixer_ctl_db_to_value(entry->ctl, value);
+        for (n = 0; n < entry->count; n++)
+            values[n] = value;
+    } else {
+        for (n = 0; n < entry->count; n++)
+            values[n] = entry->start[n] +
+                        (int) (((int64_t) entry->end - entry->start[n]) *
+                               elapsed / duration);
+    }
+
+    return 0;
+}
+
+static void mixer_ramp_tick(struct mixer_ramp *ramp)
+{
+    int values[MIXER_CTL_INT_VALUES_MAX];
+    struct mixer_ramp_entry *entry;
+    int64_t now = mixer_ramp_now();
+    unsigned int n = 0;
+    int done;
+
+    while (n < ramp->count) {
+        entry = &ramp->entries[n];
+        done = mixer_ramp_values(entry, now, values);
+        if (memcmp(values, entry->current, entry->count * sizeof(values[0]))) {
+            memcpy(entry->current, values, entry->count * sizeof(values[0]));
+            /* a control that cannot be written ends its ramp */
+            if (mixer_ctl_set_values(entry->ctl, values, entry->count) != 0)
+                done = 1;
+        }
+
+        if (done)
+            mixer_ramp_remove(ramp, n);
+        else
+            n++;
+    }
+}
+
+static void *mixer_ramp_worker(void *data)
+{
+    struct mixer_ramp *ramp = data;
+    struct pollfd pfd[2];
+    uint64_t expirations;
+
+    pfd[0].fd = ramp->timer_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ramp->stop_fd;
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (pfd[1].revents)
+            break;
+
+        if (pfd[0].revents & POLLIN) {
+            /* the timer may have been disarmed since it fired */
+            if (read(ramp->timer_fd, &expirations, sizeof(expirations)) < 0)
+                continue;
+            pthread_mutex_lock(&ramp->lock);
+            mixer_ramp_tick(ramp);
+            pthread_mutex_unlock(&ramp->lock);
+        }
+    }
+
+    return NULL;
+}
+
+/** Opens a ramp scheduler.
+ * A single worker thread, woken by a timer only while ramps are active,
+ * steps the ramps of controls of any number of mixers. The mixers must
+ * outlive the scheduler, and should be made thread safe with
+ * @ref mixer_enable_thread_safety if other threads use them too.
+ * @param step_ms The time between two steps of a ramp, in milliseconds.
+ * @returns On success, a scheduler handle.
+ *  On failure, NULL.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_ramp *mixer_ramp_open(unsigned int step_ms)
+{
+    struct mixer_ramp *ramp;
+
+    if (!step_ms)
+        return NULL;
+
+    ramp = calloc(1, sizeof(*ramp));
+    if (!ramp)
+        return NULL;
+
+    ramp->step_ms = step_ms;
+    ramp->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    ramp->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ramp->timer_fd < 0 || ramp->stop_fd < 0)
+        goto fail;
+
+    if (pthread_mutex_init(&ramp->lock, NULL) != 0)
+        goto fail;
+
+    if (pthread_create(&ramp->thread, NULL, mixer_ramp_worker, ramp) != 0) {
+        pthread_mutex_destroy(&ramp->lock);
+        goto fail;
+    }
+
+    return ramp;
+
+fail:
+    if (ramp->timer_fd >= 0)
+        close(ramp->timer_fd);
+    if (ramp->stop_fd >= 0)
+        close(ramp->stop_fd);
+    free(ramp);
+    return NULL;
+}
+
+/** Closes a ramp scheduler.
+ * Active ramps are stopped where they are.
+ * @param ramp A scheduler handle.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_ramp_close(struct mixer_ramp *ramp)
+{
+    uint64_t one = 1;
+
+    if (!ramp)
+        return;
+
+    if (write(ramp->stop_fd, &one, sizeof(one)) < 0) {
+        /* the counter cannot be saturated by a single stop */
+    }
+    pthread_join(ramp->thread, NULL);
+
+    close(ramp->timer_fd);
+    close(ramp->stop_fd);
+    pthread_mutex_destroy(&ramp->lock);
+    free(ramp->entries);
+    free(ramp);
+}
+
+/* Gets the ramp of a control, creating it if there is none.
+ * Must be called with the lock held.
+ */
+static struct mixer_ramp_entry *mixer_ramp_get_entry(struct mixer_ramp *ramp,
+                                                     struct mixer_ctl *ctl)
+{
+    struct mixer_ramp_entry *entries;
+    unsigned int capacity;
+    unsigned int n;
+
+    for (n = 0; n < ramp->count; n++)
+        if (ramp->entries[n].ctl == ctl)
+            return &ramp->entries[n];
+
+    if (ramp->count == ramp->capacity) {
+        capacity = ramp->capacity ? ramp->capacity * 2 : 4;
+        entries = realloc(ramp->entries, capacity * sizeof(*entries));
+        if (!entries)
+            return NULL;
+        ramp->entries = entries;
+        ramp->capacity = capacity;
+    }
+
+    return &ramp->entries[ramp->count];
+}
+
+/* Starts or retargets the ramp of a control from the control's current
+ * values. Must be called with the lock held.
+ */
+static int mixer_ramp_start(struct mixer_ramp *ramp, struct mixer_ctl *ctl,
+                            int db, int target, unsigned int duration_ms)
+{
+    struct mixer_ramp_entry ramp_entry;
+    struct mixer_ramp_entry *entry = &ramp_entry;
+    unsigned int count;
+    int lowest;
+    int ret;
+
+    count = mixer_ctl_get_num_values(ctl);
+    if (mixer_ctl_get_type(ctl) != MIXER_CTL_TYPE_INT || !count ||
+        count > MIXER_CTL_INT_VALUES_MAX)
+        return -EINVAL;
+
+    /* a running ramp has written the control last, so starting over from
+     * the current values continues it without a jump */
+    ret = mixer_ctl_get_values(ctl, entry->current, count);
+    if (ret < 0)
+        return ret;
+
+    entry->ctl = ctl;
+    entry->db = db;
+    entry->count = count;
+    entry->start_ns = mixer_ramp_now();
+    entry->duration_ns = (int64_t) duration_ms * 1000000;
+
+    if (db) {
+        ret = mixer_ctl_get_lowest_db(ctl, &lowest);
+        if (ret == 0)
+            ret = mixer_ctl_value_to_db(ctl, entry->current[0], &entry->start[0]);
+        if (ret < 0)
+            return ret;
+        if (entry->start[0] < lowest)
+            entry->start[0] = lowest;
+        entry->end = target < lowest ? lowest : target;
+        entry->final = mixer_ctl_db_to_value(ctl, target);
+    } else {
+        if (target < mixer_ctl_get_range_min(ctl) ||
+            target > mixer_ctl_get_range_max(ctl))
+            return -EINVAL;
+        memcpy(entry->start, entry->current, count * sizeof(entry->start[0]));
+        entry->end = target;
+        entry->final = target;
+    }
+
+    entry = mixer_ramp_get_entry(ramp, ctl);
+    if (!entry)
+        return -ENOMEM;
+    *entry = ramp_entry;
+
+    if (entry == &ramp->entries[ramp->count]) {
+        if (!ramp->count)
+            mixer_ramp_arm(ramp, 1);
+        ramp->count++;
+    }
+
+    return 0;
+}
+
+/** Ramps all values of an integer control to a raw value.
+ * Each value moves linearly from where it is to @p value over
+ * @p duration_ms milliseconds. If the control is already being ramped, the
+ * ramp is retargeted from the control's current values.
+ * @param ramp A scheduler handle.
+ * @param ctl An initialized integer control handle.
+ * @param value The raw value to ramp to.
+ * @param duration_ms The duration of the ramp.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ramp_set_value(struct mixer_ramp *ramp, struct mixer_ctl *ctl,
+                         int value, unsigned int duration_ms)
+{
+    int ret;
+
+    if (!ramp || !ctl)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ramp->lock);
+    ret = mixer_ramp_start(ramp, ctl, 0, value, duration_ms);
+    pthread_mutex_unlock(&ramp->lock);
+    return ret;
+}
+
+/** Ramps all values of a volume control to a gain in dB.
+ * The gain moves in equal dB steps from the gain of the control's first
+ * value to @p centibel over @p duration_ms milliseconds. A muted control
+ * ramps from its lowest gain. If the control is already being ramped, the
+ * ramp is retargeted from the control's current gain.
+ * @param ramp A scheduler handle.
+ * @param ctl An initialized integer control handle with dB TLV data.
+ * @param centibel The gain in 1/100 dB, or @ref MIXER_CTL_DB_MUTE.
+ * @param duration_ms The duration of the ramp.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ramp_set_db(struct mixer_ramp *ramp, struct mixer_ctl *ctl,
+                      int centibel, unsigned int duration_ms)
+{
+    int ret;
+
+    if (!ramp || !ctl)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ramp->lock);
+    ret = mixer_ramp_start(ramp, ctl, 1, centibel, duration_ms);
+    pthread_mutex_unlock(&ramp->lock);
+    return ret;
+}
+
+/** Stops the ramp of a control where it is.
+ * @param ramp A scheduler handle.
+ * @param ctl The control whose ramp to stop.
+ * @returns Zero if a ramp was stopped, -ENOENT if the control had none.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_ramp_cancel(struct mixer_ramp *ramp, struct mixer_ctl *ctl)
+{
+    unsigned int n;
+    int ret = -ENOENT;
+
+    if (!ramp || !ctl)
+        return -EINVAL;
+
+    pthread_mutex_lock(&ramp->lock);
+    for (n = 0; n < ramp->count; n++) {
+        if (ramp->entries[n].ctl == ctl) {
+            mixer_ramp_remove(ramp, n);
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ramp->lock);
+    return ret;
+}
+
+/** Gets the number of ramps in progress.
+ * @param ramp A scheduler handle.
+ * @returns The number of controls being ramped.
+ * @ingroup libtinyalsa-mixer
+ */
+unsigned int mixer_ramp_get_num_active(struct mixer_ramp *ramp)
+{
+    unsigned int count;
+
+    if (!ramp)
+        return 0;
+
+    pthread_mutex_lock(&ramp->lock);
+    count = ramp->count;
+    pthread_mutex_unlock(&ramp->lock);
+    return count;
+}
@@ -0,0 +1,662 @@
+/* mixer_route.c
+**
+** Copyright 2011, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of The Android Open Source Project nor the names of
+**       its contributors may be used to endorse or promote products derived
+**       from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY The Android Open Source Project ``AS IS'' AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+** IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+** ARE DISCLAIMED. IN NO EVENT SHALL The Android Open Source Project BE LIABLE
+** FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+** DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+** SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+** CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+** LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+** OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+** DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include <tinyalsa/mixer.h>
+
+#define ROUTE_LINE_MAX 512
+
+/** A single control value of a mixer path.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_route_setting {
+    /** The control, resolved when the route file is loaded */
+    struct mixer_ctl *ctl;
+    /** The index of the value within the control */
+    unsigned int id;
+    /** The value to set */
+    int value;
+    /** The index of the matching entry in the route's reset values */
+    unsigned int reset;
+};
+
+/** The control values that change when switching between two paths.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_route_diff {
+    /** The values to set, in the order of the route's reset values */
+    struct mixer_route_setting *settings;
+    /** The number of values to set */
+    unsigned int count;
+    /** Non-zero once the values have been computed */
+    int valid;
+};
+
+/** A named set of control values.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_route_path {
+    /** The name of the path */
+    char *name;
+    /** The control values of the path */
+    struct mixer_route_setting *settings;
+    /** The number of control values in the path */
+    unsigned int count;
+    /** The switches from this path to every path of the route, indexed
+     * like the route's paths and computed on first use */
+    struct mixer_route_diff *diffs;
+};
+
+/** A set of mixer paths loaded from a route file.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_route {
+    /** The mixer that the route belongs to */
+    struct mixer *mixer;
+    /** The paths of the route */
+    struct mixer_route_path *paths;
+    /** The number of paths */
+    unsigned int num_paths;
+    /** The values of every control used by any path, as they were when the
+     * route was loaded */
+    struct mixer_route_setting *reset;
+    /** The number of reset values */
+    unsigned int num_reset;
+    /** The transaction used to apply paths */
+    struct mixer_transaction *transaction;
+};
+
+static char *route_next_token(char **line)
+{
+    char *token;
+    char *p = *line;
+
+    while (isspace((unsigned char) *p))
+        p++;
+
+    if (*p == '\0' || *p == '#')
+        return NULL;
+
+    if (*p == '"') {
+        token = ++p;
+        while (*p && *p != '"')
+            p++;
+        if (*p != '"')
+            return NULL;
+    } else {
+        token = p;
+        while (*p && !isspace((unsigned char) *p))
+            p++;
+    }
+
+    if (*p)
+        *p++ = '\0';
+
+    *line = p;
+    return token;
+}
+
+static int route_parse_value(struct mixer_ctl *ctl, const char *string,
+                             int *value)
+{
+    unsigned int i, num_enums;
+    const char *name;
+    char *end;
+    long n;
+
+    n = strtol(string, &end, 0);
+    if (*string && !*end) {
+        *value = n;
+        return 0;
+    }
+
+    if (mixer_ctl_get_type(ctl) != MIXER_CTL_TYPE_ENUM)
+        return -EINVAL;
+
+    num_enums = mixer_ctl_get_num_enums(ctl);
+    for (i = 0; i < num_enums; i++) {
+        name = mixer_ctl_get_enum_string(ctl, i);
+        if (name && !strcmp(name, string)) {
+            *value = i;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+static int route_add_setting(struct mixer_route_path *path,
+                             struct mixer_ctl *ctl, unsigned int id,
+                             int value)
+{
+    struct mixer_route_setting *settings;
+
+    settings = realloc(path->settings, (path->count + 1) * sizeof(*settings));
+    if (!settings)
+        return -ENOMEM;
+
+    path->settings = settings;
+    settings[path->count].ctl = ctl;
+    settings[path->count].id = id;
+    settings[path->count].value = value;
+    settings[path->count].reset = 0;
+    path->count++;
+    return 0;
+}
+
+static int route_parse_setting(struct mixer_route *route,
+                               struct mixer_route_path *path, char *line)
+{
+    struct mixer_ctl *ctl;
+    unsigned int num_values;
+    unsigned int id;
+    char *name;
+    char *token;
+    int value = 0;
+    int ret;
+
+    name = route_next_token(&line);
+    if (!name)
+        return 0;
+
+    ctl = mixer_get_ctl_by_name(route->mixer, name);
+    if (!ctl) {
+        /* the same route file is often shared between hardware variants,
+         * controls that do not exist on this card are skipped */
+        return 0;
+    }
+
+    num_values = mixer_ctl_get_num_values(ctl);
+    for (id = 0; (token = route_next_token(&line)) != NULL; id++) {
+        if (id >= num_values)
+            return -EINVAL;
+        if (route_parse_value(ctl, token, &value) != 0)
+            return -EINVAL;
+        if ((mixer_ctl_get_type(ctl) == MIXER_CTL_TYPE_INT) &&
+            ((value < mixer_ctl_get_range_min(ctl)) ||
+             (value > mixer_ctl_get_range_max(ctl))))
+            return -EINVAL;
+        ret = route_add_setting(path, ctl, id, value);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (id == 0)
+        return -EINVAL;
+
+    /* a single value is set on every index of the control */
+    if (id == 1) {
+        for (id = 1; id < num_values; id++) {
+            ret = route_add_setting(path, ctl, id, value);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int route_add_path(struct mixer_route *route, const char *name)
+{
+    struct mixer_route_path *paths;
+
+    paths = realloc(route->paths, (route->num_paths + 1) * sizeof(*paths));
+    if (!paths)
+        return -ENOMEM;
+
+    route->paths = paths;
+    memset(&paths[route->num_paths], 0, sizeof(*paths));
+    paths[route->num_paths].name = strdup(name);
+    if (!paths[route->num_paths].name)
+        return -ENOMEM;
+
+    route->num_paths++;
+    return 0;
+}
+
+static int route_setting_cmp(const void *a, const void *b)
+{
+    const struct mixer_route_setting *sa = a;
+    const struct mixer_route_setting *sb = b;
+    unsigned int ida = mixer_ctl_get_id(sa->ctl);
+    unsigned int idb = mixer_ctl_get_id(sb->ctl);
+
+    if (ida != idb)
+        return ida < idb ? -1 : 1;
+
+    return sa->id < sb->id ? -1 : (sa->id > sb->id);
+}
+
+static struct mixer_route_setting *route_find_reset(struct mixer_route *route,
+                                                    const struct mixer_route_setting *setting)
+{
+    return bsearch(setting, route->reset, route->num_reset,
+                   sizeof(*route->reset), route_setting_cmp);
+}
+
+/* Collects every control value referenced by any path and snapshots its
+ * current value, so that paths can be reverted. Each path setting is linked
+ * to its reset value here, applying and reverting paths later needs no
+ * lookups at all.
+ */
+static int route_init_reset(struct mixer_route *route)
+{
+    struct mixer_route_setting *setting;
+    struct mixer_route_setting *reset;
+    struct mixer_route_path *path;
+    unsigned int total = 0;
+    unsigned int n, i, count;
+    int *values;
+    int ret;
+
+    for (n = 0; n < route->num_paths; n++)
+        total += route->paths[n].count;
+
+    if (total == 0)
+        return 0;
+
+    route->reset = calloc(total, sizeof(*route->reset));
+    if (!route->reset)
+        return -ENOMEM;
+
+    for (n = 0; n < route->num_paths; n++) {
+        path = &route->paths[n];
+        memcpy(route->reset + route->num_reset, path->settings,
+               path->count * sizeof(*path->settings));
+        route->num_reset += path->count;
+    }
+
+    qsort(route->reset, route->num_reset, sizeof(*route->reset),
+          route_setting_cmp);
+
+    /* drop duplicates */
+    for (n = 0, i = 0; n < route->num_reset; n++) {
+        if (i > 0 && route_setting_cmp(&route->reset[i - 1],
+                                       &route->reset[n]) == 0)
+            continue;
+        route->reset[i++] = route->reset[n];
+    }
+    route->num_reset = i;
+
+    /* the values of a control are adjacent and sorted by index, each
+     * control is read once up to the highest index that is used */
+    for (n = 0; n < route->num_reset; n = i) {
+        reset = &route->reset[n];
+        for (i = n + 1; i < route->num_reset; i++)
+            if (route->reset[i].ctl != reset->ctl)
+                break;
+        count = route->reset[i - 1].id + 1;
+        values = malloc(count * sizeof(*values));
+        if (!values)
+            return -ENOMEM;
+        ret = mixer_ctl_get_values(reset->ctl, values, count);
+        if (ret == 0) {
+            for (; reset < &route->reset[i]; reset++)
+                reset->value = values[reset->id];
+        }
+        free(values);
+        if (ret != 0)
+            return ret < 0 ? ret : -EIO;
+    }
+
+    for (n = 0; n < route->num_paths; n++) {
+        path = &route->paths[n];
+        for (i = 0; i < path->count; i++) {
+            setting = &path->settings[i];
+            setting->reset = route_find_reset(route, setting) - route->reset;
+        }
+    }
+
+    return 0;
+}
+
+/** Loads mixer paths from a route file.
+ * A route file is a text file that consists of paths.
+ * A path begins with a line <i>path</i> <b>name</b>,
+ * followed by lines of the form <b>control</b> <b>value</b> [<b>value</b> ...].
+ * Names that contain spaces must be enclosed in double quotes.
+ * A single value is set on every index of the control, enumerated values
+ * may be given as strings. Text following a '#' is ignored.
+ * Lines longer than 511 characters are rejected.
+ * For example:
+ * @code
+ * path speaker
+ *     "Speaker Switch" 1
+ *     "Speaker Playback Volume" 80 80
+ *     "Speaker Mux" "DAC1"
+ * @endcode
+ * All control names are resolved while loading, controls that do not
+ * exist on the card are skipped. The current values of all controls used by
+ * the route are recorded, they are restored by @ref mixer_route_reset_path.
+ * @param mixer An initialized mixer handle.
+ * @param filename The name of the route file.
+ * @returns On success, a route handle.
+ *  On failure, NULL.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_route *mixer_route_open(struct mixer *mixer, const char *filename)
+{
+    struct mixer_route *route;
+    char buf[ROUTE_LINE_MAX];
+    char *line;
+    char *token;
+    FILE *file;
+    int ret = 0;
+
+    if (!mixer || !filename)
+        return NULL;
+
+    route = calloc(1, sizeof(*route));
+    if (!route)
+        return NULL;
+    route->mixer = mixer;
+
+    file = fopen(filename, "r");
+    if (!file)
+        goto fail;
+
+    while (ret == 0 && fgets(buf, sizeof(buf), file)) {
+        line = buf;
+        if (!strchr(line, '\n') && ungetc(fgetc(file), file) != EOF) {
+            /* the line does not fit */
+            ret = -EINVAL;
+        } else if (strncmp(line, "path", 4) == 0 && isspace((unsigned char) line[4])) {
+            line += 4;
+            token = route_next_token(&line);
+            ret = token ? route_add_path(route, token) : -EINVAL;
+        } else if (route->num_paths > 0) {
+            ret = route_parse_setting(route,
+                                      &route->paths[route->num_paths - 1],
+                                      line);
+        } else if (route_next_token(&line) != NULL) {
+            /* settings outside of a path */
+            ret = -EINVAL;
+        }
+    }
+
+    fclose(file);
+    if (ret < 0)
+        goto fail;
+
+    if (route_init_reset(route) < 0)
+        goto fail;
+
+    route->transaction = mixer_transaction_begin(mixer);
+    if (!route->transaction)
+        goto fail;
+
+    return route;
+
+fail:
+    mixer_route_close(route);
+    return NULL;
+}
+
+/** Frees a route returned by @ref mixer_route_open.
+ * The control values are left as they are.
+ * @param route A route handle.
+ * @ingroup libtinyalsa-mixer
+ */
+void mixer_route_close(struct mixer_route *route)
+{
+    struct mixer_route_path *path;
+    unsigned int n, i;
+
+    if (!route)
+        return;
+
+    for (n = 0; n < route->num_paths; n++) {
+        path = &route->paths[n];
+        if (path->diffs) {
+            for (i = 0; i < route->num_paths; i++)
+                free(path->diffs[i].settings);
+            free(path->diffs);
+        }
+        free(path->name);
+        free(path->settings);
+    }
+    free(route->paths);
+    free(route->reset);
+    mixer_transaction_free(route->transaction);
+    free(route);
+}
+
+static struct mixer_route_path *route_get_path(const struct mixer_route *route,
+                                               const char *name)
+{
+    unsigned int n;
+
+    if (!name)
+        return NULL;
+
+    for (n = 0; n < route->num_paths; n++)
+        if (!strcmp(route->paths[n].name, name))
+            return &route->paths[n];
+
+    return NULL;
+}
+
+static int route_stage_path(struct mixer_route *route,
+                            const struct mixer_route_path *path, int reset)
+{
+    const struct mixer_route_setting *setting;
+    unsigned int n;
+    int ret;
+
+    for (n = 0; n < path->count; n++) {
+        setting = &path->settings[n];
+        if (reset)
+            setting = &route->reset[setting->reset];
+        ret = mixer_transaction_set_value(route->transaction, setting->ctl,
+                                          setting->id, setting->value);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/* Computes the values that change when switching from one path to another,
+ * as set by resetting @p from and then applying @p to. Values that end up
+ * the same as @p from left them are not part of the switch.
+ */
+static int route_init_diff(const struct mixer_route *route,
+                           const struct mixer_route_path *from,
+                           const struct mixer_route_path *to,
+                           struct mixer_route_diff *diff)
+{
+    const struct mixer_route_setting *setting;
+    unsigned char *used;
+    int *before;
+    int *after;
+    unsigned int n;
+    int ret = -ENOMEM;
+
+    /* bit 0: used by from, bit 1: used by to */
+    used = calloc(route->num_reset, sizeof(*used));
+    before = malloc(route->num_reset * sizeof(*before));
+    after = malloc(route->num_reset * sizeof(*after));
+    diff->settings = calloc(from->count + to->count + 1,
+                            sizeof(*diff->settings));
+    if (!used || !before || !after || !diff->settings)
+        goto out;
+
+    /* later settings of a path override earlier ones, as when staged */
+    for (n = 0; n < from->count; n++) {
+        setting = &from->settings[n];
+        used[setting->reset] |= 1;
+        before[setting->reset] = setting->value;
+    }
+    for (n = 0; n < to->count; n++) {
+        setting = &to->settings[n];
+        used[setting->reset] |= 2;
+        after[setting->reset] = setting->value;
+    }
+
+    diff->count = 0;
+    for (n = 0; n < route->num_reset; n++) {
+        if (!used[n])
+            continue;
+        if (!(used[n] & 1))
+            before[n] = route->reset[n].value;
+        if (!(used[n] & 2))
+            after[n] = route->reset[n].value;
+        if (before[n] == after[n])
+            continue;
+        diff->settings[diff->count] = route->reset[n];
+        diff->settings[diff->count].value = after[n];
+        diff->count++;
+    }
+    diff->valid = 1;
+    ret = 0;
+
+out:
+    if (ret < 0) {
+        free(diff->settings);
+        diff->settings = NULL;
+    }
+    free(used);
+    free(before);
+    free(after);
+    return ret;
+}
+
+static int route_commit(struct mixer_route *route, int ret)
+{
+    if (ret < 0) {
+        /* discard what was staged so far */
+        mixer_transaction_free(route->transaction);
+        route->transaction = mixer_transaction_begin(route->mixer);
+        return ret;
+    }
+
+    return mixer_transaction_commit(route->transaction);
+}
+
+/** Applies the values of a path.
+ * Only controls whose values differ from the path are written,
+ * each of them once.
+ * @param route A route handle.
+ * @param name The name of the path.
+ * @returns On success, zero.
+ *  On failure, a negative number.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_route_apply_path(struct mixer_route *route, const char *name)
+{
+    const struct mixer_route_path *path;
+
+    if (!route || !route->transaction)
+        return -EINVAL;
+
+    path = route_get_path(route, name);
+    if (!path)
+        return -ENOENT;
+
+    return route_commit(route, route_stage_path(route, path, 0));
+}
+
+/** Reverts the controls of a path to the values they had when the
+ * route was loaded.
+ * Only controls whose values differ are written, each of them once.
+ * @param route A route handle.
+ * @param name The name of the path.
+ * @returns On success, zero.
+ *  On failure, a negative number.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_route_reset_path(struct mixer_route *route, const char *name)
+{
+    const struct mixer_route_path *path;
+
+    if (!route || !route->transaction)
+        return -EINVAL;
+
+    path = route_get_path(route, name);
+    if (!path)
+        return -ENOENT;
+
+    return route_commit(route, route_stage_path(route, path, 1));
+}
+
+/** Switches from one path to another.
+ * This is the same as resetting @p from and applying @p to, except that
+ * controls used by both paths are not reset first, and every control is
+ * written at most once.
+ * The values that differ between the two paths are computed on the first
+ * switch between them and reused by later switches.
+ * @param route A route handle.
+ * @param from The name of the path that is currently applied.
+ * @param to The name of the path to apply.
+ * @returns On success, zero.
+ *  On failure, a negative number.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_route_switch_path(struct mixer_route *route, const char *from,
+                            const char *to)
+{
+    struct mixer_route_path *from_path;
+    const struct mixer_route_path *to_path;
+    struct mixer_route_diff *diff;
+    unsigned int n;
+    int ret = 0;
+
+    if (!route || !route->transaction)
+        return -EINVAL;
+
+    from_path = route_get_path(route, from);
+    to_path = route_get_path(route, to);
+    if (!from_path || !to_path)
+        return -ENOENT;
+
+    if (!from_path->diffs) {
+        from_path->diffs = calloc(route->num_paths, sizeof(*from_path->diffs));
+        if (!from_path->diffs)
+            return -ENOMEM;
+    }
+
+    diff = &from_path->diffs[to_path - route->paths];
+    if (!diff->valid) {
+        ret = route_init_diff(route, from_path, to_path, diff);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (n = 0; ret == 0 && n < diff->count; n++)
+        ret = mixer_transaction_set_value(route->transaction,
+                                          diff->settings[n].ctl,
+                                          diff->settings[n].id,
+                                          diff->settings[n].value);
+
+    return route_commit(route, ret);
+}
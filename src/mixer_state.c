@@ -0,0 +1,486 @@
+/* mixer_state.c
+**
+** Copyright 2011, The Android Open Source Project
+**
+** Redistribution and use in source and binary forms, with or without
+** modification, are permitted provided that the following conditions are met:
+**     * Redistributions of source code must retain the above copyright
+**       notice, this list of conditions and the following disclaimer.
+**     * Redistributions in binary form must reproduce the above copyright
+**       notice, this list of conditions and the following disclaimer in the
+**       documentation and/or other materials provided with the distribution.
+**     * Neither the name of The Android Open Source Project nor the names of
+**       its contributors may be used to endorse or promote products derived
+**       from this software without specific prior written permission.
+**
+** THIS SOFTWARE IS PROVIDED BY The Android Open Source Project ``AS IS'' AND
+** ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+** IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+** ARE DISCLAIMED. IN NO EVENT SHALL The Android Open Source Project BE LIABLE
+** FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+** DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+** SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+** CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+** LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+** OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+** DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <tinyalsa/mixer.h>
+
+/* The binary state file starts with a header of three 32 bit words: the
+ * magic, the format version and the number of records. Each record is
+ * MIXER_STATE_RECORD_WORDS words (numid, index among the controls of the
+ * same name, type, number of values and length of the name), followed by
+ * the name padded to a multiple of four bytes and one 32 bit word per
+ * value. All words are in host byte order.
+ */
+#define MIXER_STATE_MAGIC 0x53584d54 /* "TMXS" */
+#define MIXER_STATE_VERSION 1
+#define MIXER_STATE_HEADER_WORDS 3
+#define MIXER_STATE_RECORD_WORDS 5
+
+/* the largest number of values of a control (bytes controls) */
+#define MIXER_STATE_VALUES_MAX 512
+#define MIXER_STATE_NAME_MAX 64
+
+#define MIXER_STATE_PAD(len) (((len) + 3) & ~3u)
+
+typedef int (*mixer_state_visit)(void *data, struct mixer_ctl *ctl,
+                                 unsigned int index, const int *values,
+                                 unsigned int count);
+
+static int mixer_state_supported(const struct mixer_ctl *ctl)
+{
+    switch (mixer_ctl_get_type(ctl)) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+    case MIXER_CTL_TYPE_ENUM:
+        return 1;
+    case MIXER_CTL_TYPE_BYTE:
+        return !mixer_ctl_is_access_tlv_rw(ctl);
+    default:
+        return 0;
+    }
+}
+
+/* Gets the index of a control among the controls of the same name */
+static unsigned int mixer_state_name_index(struct mixer *mixer,
+                                           const struct mixer_ctl *ctl)
+{
+    const char *name = mixer_ctl_get_name(ctl);
+    struct mixer_ctl *other;
+    unsigned int index;
+
+    for (index = 0; ; index++) {
+        other = mixer_get_ctl_by_name_and_index(mixer, name, index);
+        if (!other || other == ctl)
+            return index;
+    }
+}
+
+/* Calls visit for each control whose values can be saved.
+ * Controls that cannot be read (e.g. write only or inactive) are skipped.
+ */
+static int mixer_state_for_each(struct mixer *mixer, mixer_state_visit visit,
+                                void *data)
+{
+    int values[MIXER_STATE_VALUES_MAX];
+    struct mixer_ctl *ctl;
+    unsigned int num_ctls;
+    unsigned int count;
+    unsigned int n;
+    int ret;
+
+    num_ctls = mixer_get_num_ctls(mixer);
+    for (n = 0; n < num_ctls; n++) {
+        ctl = mixer_get_ctl(mixer, n);
+        if (!ctl || !mixer_state_supported(ctl))
+            continue;
+
+        count = mixer_ctl_get_num_values(ctl);
+        if (!count || count > MIXER_STATE_VALUES_MAX ||
+            strlen(mixer_ctl_get_name(ctl)) >= MIXER_STATE_NAME_MAX)
+            continue;
+
+        if (mixer_ctl_get_values(ctl, values, count) != 0)
+            continue;
+
+        ret = visit(data, ctl, mixer_state_name_index(mixer, ctl), values,
+                    count);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/** A growing buffer that the binary state is built in.
+ * @ingroup libtinyalsa-mixer
+ */
+struct mixer_state_buffer {
+    /** The words of the state file */
+    uint32_t *words;
+    /** The number of words used */
+    size_t size;
+    /** The number of words allocated */
+    size_t capacity;
+    /** The number of records */
+    uint32_t count;
+};
+
+static uint32_t *mixer_state_reserve(struct mixer_state_buffer *buffer,
+                                     size_t words)
+{
+    uint32_t *tmp;
+    size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+
+    while (capacity < buffer->size + words)
+        capacity *= 2;
+
+    if (capacity != buffer->capacity) {
+        tmp = realloc(buffer->words, capacity * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        buffer->words = tmp;
+        buffer->capacity = capacity;
+    }
+
+    tmp = buffer->words + buffer->size;
+    buffer->size += words;
+    return tmp;
+}
+
+static int mixer_state_add_record(void *data, struct mixer_ctl *ctl,
+                                  unsigned int index, const int *values,
+                                  unsigned int count)
+{
+    struct mixer_state_buffer *buffer = data;
+    const char *name = mixer_ctl_get_name(ctl);
+    size_t len = strlen(name);
+    size_t name_words = MIXER_STATE_PAD(len) / 4;
+    uint32_t *record;
+    unsigned int n;
+
+    record = mixer_state_reserve(buffer, MIXER_STATE_RECORD_WORDS +
+                                 name_words + count);
+    if (!record)
+        return -ENOMEM;
+
+    record[0] = mixer_ctl_get_id(ctl) + 1;
+    record[1] = index;
+    record[2] = mixer_ctl_get_type(ctl);
+    record[3] = count;
+    record[4] = len;
+    record += MIXER_STATE_RECORD_WORDS;
+
+    memset(record, 0, name_words * 4);
+    memcpy(record, name, len);
+    record += name_words;
+
+    for (n = 0; n < count; n++)
+        record[n] = (uint32_t) values[n];
+
+    buffer->count++;
+    return 0;
+}
+
+/** Saves the values of all controls to a file.
+ * Each control is read with a single ioctl. The file is written next to
+ * @p filename and renamed over it, so an interrupted save does not leave a
+ * truncated state behind.
+ * TLV byte controls and controls that cannot be read are not saved.
+ * @param mixer An initialized mixer handle.
+ * @param filename The state file to write.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_state_save(struct mixer *mixer, const char *filename)
+{
+    struct mixer_state_buffer buffer;
+    uint32_t *header;
+    char *tmpname = NULL;
+    FILE *file = NULL;
+    int ret;
+
+    if (!mixer || !filename)
+        return -EINVAL;
+
+    memset(&buffer, 0, sizeof(buffer));
+    header = mixer_state_reserve(&buffer, MIXER_STATE_HEADER_WORDS);
+    if (!header)
+        return -ENOMEM;
+
+    ret = mixer_state_for_each(mixer, mixer_state_add_record, &buffer);
+    if (ret < 0)
+        goto done;
+
+    buffer.words[0] = MIXER_STATE_MAGIC;
+    buffer.words[1] = MIXER_STATE_VERSION;
+    buffer.words[2] = buffer.count;
+
+    tmpname = malloc(strlen(filename) + 5);
+    if (!tmpname) {
+        ret = -ENOMEM;
+        goto done;
+    }
+    sprintf(tmpname, "%s.tmp", filename);
+
+    file = fopen(tmpname, "wb");
+    if (!file) {
+        ret = -errno;
+        goto done;
+    }
+
+    if (fwrite(buffer.words, sizeof(uint32_t), buffer.size, file) != buffer.size) {
+        ret = -EIO;
+        fclose(file);
+        goto fail_unlink;
+    }
+
+    if (fclose(file) != 0) {
+        ret = -errno;
+        goto fail_unlink;
+    }
+
+    if (rename(tmpname, filename) != 0) {
+        ret = -errno;
+        goto fail_unlink;
+    }
+
+    ret = 0;
+    goto done;
+
+fail_unlink:
+    remove(tmpname);
+done:
+    free(tmpname);
+    free(buffer.words);
+    return ret;
+}
+
+static int mixer_state_read_file(const char *filename, uint32_t **words,
+                                 size_t *size)
+{
+    FILE *file;
+    long length;
+    int ret = 0;
+
+    file = fopen(filename, "rb");
+    if (!file)
+        return -errno;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        ret = -errno;
+        goto done;
+    }
+
+    if ((length % 4) || (length < MIXER_STATE_HEADER_WORDS * 4)) {
+        ret = -EINVAL;
+        goto done;
+    }
+
+    *words = malloc(length);
+    if (!*words) {
+        ret = -ENOMEM;
+        goto done;
+    }
+
+    if (fread(*words, 1, length, file) != (size_t) length) {
+        free(*words);
+        ret = -EIO;
+        goto done;
+    }
+    *size = length / 4;
+
+done:
+    fclose(file);
+    return ret;
+}
+
+/* Checks that the header's number of records are all present, complete
+ * and within the limits, so that a corrupt file is rejected before any
+ * control is written.
+ */
+static int mixer_state_check(const uint32_t *words, size_t size)
+{
+    size_t pos = MIXER_STATE_HEADER_WORDS;
+    const uint32_t *record;
+    uint32_t n;
+
+    if (words[0] != MIXER_STATE_MAGIC || words[1] != MIXER_STATE_VERSION)
+        return -EINVAL;
+
+    for (n = 0; n < words[2]; n++) {
+        if (size - pos < MIXER_STATE_RECORD_WORDS)
+            return -EINVAL;
+        record = words + pos;
+        if (record[4] >= MIXER_STATE_NAME_MAX ||
+            record[3] > MIXER_STATE_VALUES_MAX)
+            return -EINVAL;
+        pos += MIXER_STATE_RECORD_WORDS;
+        if (size - pos < MIXER_STATE_PAD(record[4]) / 4 + record[3])
+            return -EINVAL;
+        pos += MIXER_STATE_PAD(record[4]) / 4 + record[3];
+    }
+
+    return 0;
+}
+
+/** Restores the values of controls from a file written by
+ * @ref mixer_state_save.
+ * Each saved control is looked up by its numid, and by its name and index if
+ * the numid refers to a different control (e.g. after a driver update).
+ * Its current values are read and compared with the saved ones, and only
+ * controls that differ are written, each with a single ioctl.
+ * Saved controls that no longer exist or changed type or size are skipped.
+ * The whole file is checked first, a truncated or corrupt file is rejected
+ * without writing any control.
+ * @param mixer An initialized mixer handle.
+ * @param filename The state file to read.
+ * @returns On success, the number of controls written.
+ *  On failure, a negative errno value, -EINVAL if the file is not a valid
+ *  state file. If writing a control fails, the other controls are still
+ *  restored and the error is returned.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_state_restore(struct mixer *mixer, const char *filename)
+{
+    int current[MIXER_STATE_VALUES_MAX];
+    char name[MIXER_STATE_NAME_MAX];
+    struct mixer_ctl *ctl;
+    uint32_t *words = NULL;
+    const uint32_t *record;
+    size_t size = 0;
+    size_t pos;
+    size_t name_words;
+    uint32_t count;
+    uint32_t len;
+    uint32_t n;
+    int written = 0;
+    int error = 0;
+    int ret;
+
+    if (!mixer || !filename)
+        return -EINVAL;
+
+    ret = mixer_state_read_file(filename, &words, &size);
+    if (ret < 0)
+        return ret;
+
+    ret = mixer_state_check(words, size);
+    if (ret < 0) {
+        free(words);
+        return ret;
+    }
+
+    pos = MIXER_STATE_HEADER_WORDS;
+    for (n = 0; n < words[2]; n++) {
+        record = words + pos;
+        count = record[3];
+        len = record[4];
+        name_words = MIXER_STATE_PAD(len) / 4;
+        pos += MIXER_STATE_RECORD_WORDS + name_words + count;
+
+        memcpy(name, record + MIXER_STATE_RECORD_WORDS, len);
+        name[len] = '\0';
+
+        ctl = mixer_get_ctl(mixer, record[0] - 1);
+        if (!ctl || strcmp(name, mixer_ctl_get_name(ctl)))
+            ctl = mixer_get_ctl_by_name_and_index(mixer, name, record[1]);
+        if (!ctl || ((uint32_t) mixer_ctl_get_type(ctl) != record[2]) ||
+            (mixer_ctl_get_num_values(ctl) != count) || !count)
+            continue;
+
+        record += MIXER_STATE_RECORD_WORDS + name_words;
+        if (mixer_ctl_get_values(ctl, current, count) == 0 &&
+            !memcmp(current, record, count * sizeof(current[0])))
+            continue;
+
+        ret = mixer_ctl_set_values(ctl, (const int *) record, count);
+        if (ret < 0) {
+            if (!error)
+                error = ret;
+            continue;
+        }
+        written++;
+    }
+
+    free(words);
+    return error ? error : written;
+}
+
+static int mixer_state_print_record(void *data, struct mixer_ctl *ctl,
+                                    unsigned int index, const int *values,
+                                    unsigned int count)
+{
+    FILE *file = data;
+    const char *string;
+    unsigned int n;
+
+    fprintf(file, "%u\t\"%s\"\t%u\t%s\t", mixer_ctl_get_id(ctl) + 1,
+            mixer_ctl_get_name(ctl), index, mixer_ctl_get_type_string(ctl));
+
+    for (n = 0; n < count; n++) {
+        if (n)
+            fputc(' ', file);
+        string = NULL;
+        if (mixer_ctl_get_type(ctl) == MIXER_CTL_TYPE_ENUM)
+            string = mixer_ctl_get_enum_string(ctl, values[n]);
+        if (string)
+            fprintf(file, "\"%s\"", string);
+        else
+            fprintf(file, "%d", values[n]);
+    }
+    fputc('\n', file);
+
+    return ferror(file) ? -EIO : 0;
+}
+
+/** Writes the values of all controls to a text file, for inspection.
+ * Each line holds the numid, the quoted name, the index among controls of
+ * the same name, the type and the values of a control, separated by tabs.
+ * Enumerated values are written as quoted item names.
+ * The controls are the same that @ref mixer_state_save saves.
+ * @param mixer An initialized mixer handle.
+ * @param filename The file to write, or "-" for the standard output.
+ * @returns On success, zero.
+ *  On failure, a negative errno value.
+ * @ingroup libtinyalsa-mixer
+ */
+int mixer_state_export(struct mixer *mixer, const char *filename)
+{
+    FILE *file;
+    int ret;
+
+    if (!mixer || !filename)
+        return -EINVAL;
+
+    if (!strcmp(filename, "-")) {
+        file = stdout;
+    } else {
+        file = fopen(filename, "w");
+        if (!file)
+            return -errno;
+    }
+
+    fprintf(file, "# %s\n", mixer_get_name(mixer));
+    ret = mixer_state_for_each(mixer, mixer_state_print_record, file);
+
+    if (file == stdout) {
+        if (fflush(file) != 0 && ret == 0)
+            ret = -errno;
+    } else if (fclose(file) != 0 && ret == 0) {
+        ret = -errno;
+    }
+
+    return ret;
+}
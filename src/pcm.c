@@ -262,6 +262,18 @@ unsigned int pcm_get_buffer_size(const struct pcm *pcm)
     return pcm->buffer_size;
 }
 
+/** Gets the number of xruns (underruns or overruns) met by
+ * @ref pcm_readi, @ref pcm_writei and friends since the PCM was opened.
+ * Unless @ref PCM_NORESTART was given, the PCM was restarted after each.
+ * @param pcm A PCM handle.
+ * @return The number of xruns of the PCM.
+ * @ingroup libtinyalsa-pcm
+ */
+unsigned int pcm_get_xruns(const struct pcm *pcm)
+{
+    return pcm->xruns;
+}
+
 /** Gets the channel count of the PCM.
  * @param pcm A PCM handle.
  * @return The channel count of the PCM.
@@ -1141,9 +1153,20 @@ static int pcm_mmap_transfer_areas(struct pcm *pcm, char *buf,
     return count;
 }
 
+/** Gets the number of frames available in the buffer of a PCM opened with
+ * @ref PCM_MMAP, after syncing the pointers with the kernel.
+ * For an output stream, these are the empty frames that can be written.
+ * For an input stream, these are the captured frames that can be read.
+ * Together with @ref pcm_mmap_begin and @ref pcm_mmap_commit, this lets
+ * callers read or write the audio in place, in the DMA buffer.
+ * @param pcm A PCM handle.
+ * @return On success, the number of available frames; on failure, -1.
+ * @ingroup libtinyalsa-pcm
+ */
 int pcm_avail_update(struct pcm *pcm)
 {
-    pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_APPL|SNDRV_PCM_SYNC_PTR_AVAIL_MIN);
+    if (pcm_sync_ptr(pcm, SNDRV_PCM_SYNC_PTR_APPL|SNDRV_PCM_SYNC_PTR_AVAIL_MIN) < 0)
+        return -1;
     return pcm_mmap_avail(pcm);
 }
 
@@ -1193,6 +1216,35 @@ again:
     return 0;
 }
 
+/** Gets the time a PCM was last started, stopped or paused.
+ * The clock is the one described in @ref pcm_get_htimestamp.
+ * PCMs linked with @ref pcm_link and started together share this time stamp.
+ * @param pcm A PCM handle.
+ * @param tstamp The time stamp
+ * @return On success, zero is returned; on failure, a negative number.
+ * @ingroup libtinyalsa-pcm
+ */
+int pcm_get_trigger_timestamp(struct pcm *pcm, struct timespec *tstamp)
+{
+    struct snd_pcm_status status;
+
+    if (!pcm_is_ready(pcm))
+        return -1;
+
+    memset(&status, 0, sizeof(status));
+    if (ioctl(pcm->fd, SNDRV_PCM_IOCTL_STATUS, &status) < 0)
+        return oops(pcm, errno, "cannot get PCM status");
+
+    *tstamp = status.trigger_tstamp;
+    return 0;
+}
+
+/** Gets the state of a PCM.
+ * @param pcm A PCM handle.
+ * @return On success, one of the PCM_STATE_ values (e.g.
+ *  @ref PCM_STATE_RUNNING); on failure, a negative number.
+ * @ingroup libtinyalsa-pcm
+ */
 int pcm_state(struct pcm *pcm)
 {
     int err = pcm_sync_ptr(pcm, 0);
@@ -1312,7 +1364,10 @@ int pcm_mmap_transfer(struct pcm *pcm, void *buffer, unsigned int frames)
             }
 
             /* get hardware pointer */
-            avail = pcm_avail_update(pcm);
+            tmp = pcm_avail_update(pcm);
+            if (tmp < 0)
+                break;
+            avail = tmp;
         }
 
         tmp = pcm_mmap_transfer_areas(pcm, buffer, user_offset, frames);
@@ -0,0 +1,127 @@
+/* mixer_state_test.c
+**
+** Saves the state of the stub mixer, then checks that restoring brings
+** back the saved values and that truncated or corrupt files are rejected
+** without writing any control.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "mixer_stub.h"
+
+#define VOLUME "Master Playback Volume"
+
+static int failures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static long read_state(const char *filename, uint32_t *words, size_t max)
+{
+    FILE *file = fopen(filename, "rb");
+    size_t size;
+
+    if (!file)
+        return -errno;
+    size = fread(words, 4, max, file);
+    fclose(file);
+    return size;
+}
+
+static int write_state(const char *filename, const uint32_t *words, size_t size)
+{
+    FILE *file = fopen(filename, "wb");
+
+    if (!file)
+        return -errno;
+    if (fwrite(words, 4, size, file) != size) {
+        fclose(file);
+        return -EIO;
+    }
+    return fclose(file) ? -errno : 0;
+}
+
+/* Writes a modified copy of the saved state and checks that restoring it
+ * fails with -EINVAL and leaves the controls untouched.
+ */
+static void check_rejected(struct mixer *mixer, const char *filename,
+                           const uint32_t *words, size_t size)
+{
+    CHECK(write_state(filename, words, size) == 0);
+    mixer_stub_writes = 0;
+    CHECK(mixer_state_restore(mixer, filename) == -EINVAL);
+    CHECK(mixer_stub_writes == 0);
+    CHECK(mixer_stub_peek(mixer, VOLUME, 0) == 20);
+}
+
+int main(void)
+{
+    char filename[] = "/tmp/mixer-state-test-XXXXXX";
+    uint32_t saved[1024];
+    uint32_t words[1024];
+    struct mixer *mixer;
+    long size;
+    int fd;
+
+    fd = mkstemp(filename);
+    if (fd < 0) {
+        perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    mixer = mixer_open(0);
+    CHECK(mixer_state_save(mixer, filename) == 0);
+    size = read_state(filename, saved, sizeof(saved) / sizeof(saved[0]));
+    CHECK(size > 3 + 5);
+    if (size <= 3 + 5) {
+        unlink(filename);
+        return EXIT_FAILURE;
+    }
+
+    mixer_stub_poke(mixer, VOLUME, 0, 20);
+
+    /* a file cut in the middle of the last record */
+    check_rejected(mixer, filename, saved, size - 1);
+
+    /* a header announcing more records than the file holds */
+    memcpy(words, saved, size * 4);
+    words[2]++;
+    check_rejected(mixer, filename, words, size);
+
+    /* a first record with a name longer than any control name */
+    memcpy(words, saved, size * 4);
+    words[3 + 4] = 200;
+    check_rejected(mixer, filename, words, size);
+
+    /* a first record with more values than any control has */
+    memcpy(words, saved, size * 4);
+    words[3 + 3] = 0x10000;
+    check_rejected(mixer, filename, words, size);
+
+    /* a bad magic */
+    memcpy(words, saved, size * 4);
+    words[0] = 0;
+    check_rejected(mixer, filename, words, size);
+
+    /* the intact file restores the changed control only */
+    CHECK(write_state(filename, saved, size) == 0);
+    mixer_stub_writes = 0;
+    CHECK(mixer_state_restore(mixer, filename) == 1);
+    CHECK(mixer_stub_writes == 1);
+    CHECK(mixer_stub_peek(mixer, VOLUME, 0) == 50);
+
+    mixer_close(mixer);
+    unlink(filename);
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
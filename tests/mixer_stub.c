@@ -0,0 +1,355 @@
+/* mixer_stub.c
+**
+** An in-memory stand-in for the mixer API. The mixer has a fixed set of
+** controls, every write is counted in mixer_stub_writes and logged to
+** stdout as "write <name> <values>", so tests can check what was written
+** and in which order.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+
+#include "mixer_stub.h"
+
+#define MIXER_STUB_VALUES_MAX 8
+#define MIXER_STUB_CTLS 4
+
+struct mixer_ctl {
+    const char *name;
+    enum mixer_ctl_type type;
+    unsigned int count;
+    int min;
+    int max;
+    int values[MIXER_STUB_VALUES_MAX];
+};
+
+struct mixer {
+    struct mixer_ctl *ctls;
+    unsigned int count;
+};
+
+static struct mixer_ctl mixer_stub_ctls[MIXER_STUB_CTLS] = {
+    { "Master Playback Switch", MIXER_CTL_TYPE_BOOL, 1, 0, 1, { 1 } },
+    { "Master Playback Volume", MIXER_CTL_TYPE_INT, 2, 0, 100, { 50, 50 } },
+    { "Capture Source", MIXER_CTL_TYPE_ENUM, 1, 0, 2, { 0 } },
+    { "Codec Data", MIXER_CTL_TYPE_BYTE, 8, 0, 255, { 1, 2, 3, 4, 5, 6, 7, 8 } },
+};
+
+static const char *mixer_stub_enums[] = { "Mic", "Line", "Digital" };
+
+static struct mixer mixer_stub = { mixer_stub_ctls, MIXER_STUB_CTLS };
+
+struct mixer_transaction {
+    int staged[MIXER_STUB_CTLS];
+    int values[MIXER_STUB_CTLS][MIXER_STUB_VALUES_MAX];
+};
+
+unsigned int mixer_stub_writes;
+
+static void mixer_stub_log(const struct mixer_ctl *ctl)
+{
+    unsigned int n;
+
+    mixer_stub_writes++;
+    printf("write %s", ctl->name);
+    for (n = 0; n < ctl->count; n++)
+        printf(" %d", ctl->values[n]);
+    printf("\n");
+    fflush(stdout);
+}
+
+void mixer_stub_poke(struct mixer *mixer, const char *name, unsigned int id,
+                     int value)
+{
+    mixer_get_ctl_by_name(mixer, name)->values[id] = value;
+}
+
+int mixer_stub_peek(struct mixer *mixer, const char *name, unsigned int id)
+{
+    return mixer_get_ctl_by_name(mixer, name)->values[id];
+}
+
+struct mixer *mixer_open(unsigned int card)
+{
+    return card == 0 ? &mixer_stub : NULL;
+}
+
+void mixer_close(struct mixer *mixer)
+{
+    (void) mixer;
+}
+
+const char *mixer_get_name(const struct mixer *mixer)
+{
+    (void) mixer;
+    return "Stub";
+}
+
+unsigned int mixer_get_num_ctls(const struct mixer *mixer)
+{
+    return mixer->count;
+}
+
+struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
+{
+    return id < mixer->count ? &mixer->ctls[id] : NULL;
+}
+
+struct mixer_ctl *mixer_get_ctl_by_name_and_index(struct mixer *mixer,
+                                                  const char *name,
+                                                  unsigned int index)
+{
+    unsigned int n;
+
+    for (n = 0; n < mixer->count; n++)
+        if (!strcmp(mixer->ctls[n].name, name) && index-- == 0)
+            return &mixer->ctls[n];
+
+    return NULL;
+}
+
+struct mixer_ctl *mixer_get_ctl_by_name(struct mixer *mixer, const char *name)
+{
+    return mixer_get_ctl_by_name_and_index(mixer, name, 0);
+}
+
+unsigned int mixer_ctl_get_id(const struct mixer_ctl *ctl)
+{
+    return ctl - mixer_stub.ctls;
+}
+
+const char *mixer_ctl_get_name(const struct mixer_ctl *ctl)
+{
+    return ctl->name;
+}
+
+enum mixer_ctl_type mixer_ctl_get_type(const struct mixer_ctl *ctl)
+{
+    return ctl->type;
+}
+
+const char *mixer_ctl_get_type_string(const struct mixer_ctl *ctl)
+{
+    static const char *types[] = { "BOOL", "INT", "ENUM", "BYTE", "IEC958", "INT64" };
+
+    return ctl->type < sizeof(types) / sizeof(types[0]) ? types[ctl->type] : "Unknown";
+}
+
+unsigned int mixer_ctl_get_num_values(const struct mixer_ctl *ctl)
+{
+    return ctl->count;
+}
+
+int mixer_ctl_is_access_tlv_rw(const struct mixer_ctl *ctl)
+{
+    (void) ctl;
+    return 0;
+}
+
+unsigned int mixer_ctl_get_num_enums(const struct mixer_ctl *ctl)
+{
+    return ctl->type == MIXER_CTL_TYPE_ENUM ? ctl->max + 1 : 0;
+}
+
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl,
+                                      unsigned int enum_id)
+{
+    if (ctl->type != MIXER_CTL_TYPE_ENUM || enum_id > (unsigned int) ctl->max)
+        return NULL;
+
+    return mixer_stub_enums[enum_id];
+}
+
+int mixer_ctl_get_range_min(const struct mixer_ctl *ctl)
+{
+    return ctl->type == MIXER_CTL_TYPE_INT ? ctl->min : -EINVAL;
+}
+
+int mixer_ctl_get_range_max(const struct mixer_ctl *ctl)
+{
+    return ctl->type == MIXER_CTL_TYPE_INT ? ctl->max : -EINVAL;
+}
+
+int mixer_ctl_get_values(const struct mixer_ctl *ctl, int *values,
+                         unsigned int count)
+{
+    if (!count || count > ctl->count)
+        return -EINVAL;
+
+    memcpy(values, ctl->values, count * sizeof(values[0]));
+    return 0;
+}
+
+int mixer_ctl_get_value(const struct mixer_ctl *ctl, unsigned int id)
+{
+    return id < ctl->count ? ctl->values[id] : -EINVAL;
+}
+
+int mixer_ctl_set_values(struct mixer_ctl *ctl, const int *values,
+                         unsigned int count)
+{
+    unsigned int n;
+
+    if (!count || count > ctl->count)
+        return -EINVAL;
+
+    for (n = 0; n < count; n++)
+        if (values[n] < ctl->min || values[n] > ctl->max)
+            return -EINVAL;
+
+    memcpy(ctl->values, values, count * sizeof(values[0]));
+    mixer_stub_log(ctl);
+    return 0;
+}
+
+int mixer_ctl_get_array(const struct mixer_ctl *ctl, void *array, size_t count)
+{
+    unsigned char *bytes = array;
+    size_t n;
+
+    if (!count || count > ctl->count)
+        return -EINVAL;
+
+    if (ctl->type != MIXER_CTL_TYPE_BYTE)
+        return mixer_ctl_get_values(ctl, array, count);
+
+    for (n = 0; n < count; n++)
+        bytes[n] = ctl->values[n];
+    return 0;
+}
+
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+{
+    const unsigned char *bytes = array;
+    size_t n;
+
+    if (!count || count > ctl->count)
+        return -EINVAL;
+
+    if (ctl->type != MIXER_CTL_TYPE_BYTE)
+        return mixer_ctl_set_values(ctl, array, count);
+
+    for (n = 0; n < count; n++)
+        ctl->values[n] = bytes[n];
+    mixer_stub_log(ctl);
+    return 0;
+}
+
+int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string)
+{
+    unsigned int n;
+
+    for (n = 0; n < mixer_ctl_get_num_enums(ctl); n++)
+        if (!strcmp(mixer_stub_enums[n], string))
+            return mixer_ctl_set_values(ctl, (const int *) &n, 1);
+
+    return -EINVAL;
+}
+
+int mixer_ctl_get_iec958(const struct mixer_ctl *ctl,
+                         struct mixer_iec958 *iec958)
+{
+    (void) ctl;
+    (void) iec958;
+    return -EINVAL;
+}
+
+void mixer_ctl_update(struct mixer_ctl *ctl)
+{
+    (void) ctl;
+}
+
+int mixer_find_ctls(struct mixer *mixer, const char *pattern,
+                    mixer_ctl_callback callback, void *data)
+{
+    unsigned int n;
+    int found = 0;
+
+    for (n = 0; n < mixer->count; n++) {
+        if (fnmatch(pattern, mixer->ctls[n].name, 0))
+            continue;
+        found++;
+        if (callback(&mixer->ctls[n], data))
+            break;
+    }
+
+    return found;
+}
+
+int mixer_add_new_ctls(struct mixer *mixer)
+{
+    (void) mixer;
+    return 0;
+}
+
+int mixer_subscribe_events(struct mixer *mixer, int subscribe)
+{
+    (void) mixer;
+    (void) subscribe;
+    return 0;
+}
+
+int mixer_wait_event(struct mixer *mixer, int timeout)
+{
+    (void) mixer;
+    (void) timeout;
+    return 0;
+}
+
+int mixer_read_event(struct mixer *mixer, struct mixer_ctl_event *events,
+                     unsigned int count)
+{
+    (void) mixer;
+    (void) events;
+    (void) count;
+    return 0;
+}
+
+struct mixer_transaction *mixer_transaction_begin(struct mixer *mixer)
+{
+    (void) mixer;
+    return calloc(1, sizeof(struct mixer_transaction));
+}
+
+void mixer_transaction_free(struct mixer_transaction *transaction)
+{
+    free(transaction);
+}
+
+int mixer_transaction_set_value(struct mixer_transaction *transaction,
+                                struct mixer_ctl *ctl, unsigned int id,
+                                int value)
+{
+    unsigned int n = mixer_ctl_get_id(ctl);
+
+    if (id >= ctl->count)
+        return -EINVAL;
+
+    if (!transaction->staged[n]) {
+        memcpy(transaction->values[n], ctl->values, sizeof(ctl->values));
+        transaction->staged[n] = 1;
+    }
+    transaction->values[n][id] = value;
+    return 0;
+}
+
+/* Writes each staged control with a single call, in id order. */
+int mixer_transaction_commit(struct mixer_transaction *transaction)
+{
+    unsigned int n;
+    int ret = 0;
+
+    for (n = 0; n < MIXER_STUB_CTLS; n++) {
+        if (!transaction->staged[n])
+            continue;
+        transaction->staged[n] = 0;
+        if (mixer_ctl_set_values(&mixer_stub_ctls[n], transaction->values[n],
+                                 mixer_stub_ctls[n].count) < 0)
+            ret = -EINVAL;
+    }
+
+    return ret;
+}
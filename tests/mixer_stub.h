@@ -0,0 +1,22 @@
+/* mixer_stub.h
+**
+** An in-memory stand-in for the mixer API, so that code built on top of
+** the mixer can be tested without a sound card.
+*/
+
+#ifndef TINYALSA_TESTS_MIXER_STUB_H
+#define TINYALSA_TESTS_MIXER_STUB_H
+
+#include <tinyalsa/mixer.h>
+
+/* the number of controls written since the last reset */
+extern unsigned int mixer_stub_writes;
+
+/* Sets a value of a control without counting it as a write */
+void mixer_stub_poke(struct mixer *mixer, const char *name, unsigned int id,
+                     int value);
+
+/* Gets a value of a control */
+int mixer_stub_peek(struct mixer *mixer, const char *name, unsigned int id);
+
+#endif
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Runs tinymix scripts against the stub mixer and checks the order in which
+# controls are written.
+# usage: tinymix_script_test.sh TINYMIX
+
+tinymix="$1"
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+check() {
+    if ! diff -u "$dir/expected" "$dir/output"; then
+        echo "$1: unexpected writes" >&2
+        failures=$((failures + 1))
+    fi
+}
+
+# a set that cannot be staged is written after the staged sets before it
+cat > "$dir/script" <<'SCRIPT'
+set "Master Playback Volume" 10
+set "Master Playback Switch" 0
+set "Codec Data" 9 9 9 9 9 9 9 9
+set "Master Playback Volume" 30
+SCRIPT
+cat > "$dir/expected" <<'OUTPUT'
+write Master Playback Switch 0
+write Master Playback Volume 10 10
+write Codec Data 9 9 9 9 9 9 9 9
+write Master Playback Volume 30 30
+OUTPUT
+"$tinymix" -f "$dir/script" > "$dir/output" || failures=$((failures + 1))
+check "mixed sets"
+
+# a line too long for the buffer fails on its own, the others still run
+{
+    printf 'set "Master Playback Volume" 10'
+    i=0
+    while [ $i -lt 500 ]; do
+        printf '          '
+        i=$((i + 1))
+    done
+    printf '20\n'
+    printf 'set "Master Playback Volume" 30\n'
+} > "$dir/script"
+cat > "$dir/expected" <<'OUTPUT'
+write Master Playback Volume 30 30
+OUTPUT
+if "$tinymix" -f "$dir/script" > "$dir/output" 2> "$dir/errors"; then
+    echo "long line: script did not fail" >&2
+    failures=$((failures + 1))
+fi
+check "long line"
+if ! grep -q ':1: line longer than' "$dir/errors"; then
+    echo "long line: not reported with its line number" >&2
+    failures=$((failures + 1))
+fi
+
+[ $failures -eq 0 ]
@@ -26,6 +26,7 @@
 ** DAMAGE.
 */
 
+#define _GNU_SOURCE
 #include <tinyalsa/asoundlib.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,11 +34,25 @@
 #include <signal.h>
 #include <string.h>
 #include <limits.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
 
 #define ID_RIFF 0x46464952
+#define ID_RF64 0x34364652
 #define ID_WAVE 0x45564157
+#define ID_DS64 0x34367364
 #define ID_FMT  0x20746d66
 #define ID_DATA 0x61746164
+#define ID_JUNK 0x4b4e554a
 
 #define FORMAT_PCM 1
 
@@ -57,13 +72,69 @@ struct wav_header {
     uint32_t data_sz;
 };
 
+struct chunk_header {
+    uint32_t id;
+    uint32_t sz;
+};
+
+/* The size of the ds64 chunk of an RF64 file, without a table */
+#define DS64_SIZE 28
+
+/* The RIFF header, a ds64 chunk (a JUNK chunk until the file is too big for
+ * RIFF), the fmt chunk and the data chunk header */
+#define WAV_HEADER_SIZE (12 + 8 + DS64_SIZE + 24 + 8)
+
+/* The options of the writer thread */
+struct writer_config {
+    /* the size of the ring, in milliseconds of audio */
+    unsigned int ring_time;
+    /* write with O_DIRECT */
+    int direct;
+    /* preallocate the file in steps of this many MiB, zero to disable */
+    unsigned int prealloc;
+    /* where the audio starts in the file */
+    off_t data_offset;
+    /* the file to write, NULL to write raw audio to stdout */
+    const char *filename;
+    /* start a new file after this many frames, zero to disable */
+    unsigned long long segment_frames;
+    /* only write after SIGUSR1 */
+    int trigger;
+    /* when waiting for SIGUSR1 or a level, the number of seconds written
+     * from before it */
+    unsigned int pretrigger_time;
+    /* write each channel to its own file */
+    int split;
+};
+
+/* Recording starts once the peak of a period reaches start, and stops once
+ * the RMS level stayed below stop for hangover milliseconds.
+ */
+struct level_config {
+    /* in dBFS */
+    float start;
+    float stop;
+    unsigned int hangover;
+};
+
 int capturing = 1;
 int prinfo = 1;
+volatile sig_atomic_t triggered = 0;
+
+/* The most devices captured together */
+#define CAPTURE_DEVICES_MAX 8
 
-unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
-                            unsigned int channels, unsigned int rate,
-                            enum pcm_format format, unsigned int period_size,
-                            unsigned int period_count, unsigned int capture_time);
+unsigned long long capture_sample(const struct wav_header *header,
+                                  unsigned int card,
+                                  const unsigned int *devices,
+                                  unsigned int num_devices,
+                                  unsigned int flags, unsigned int channels,
+                                  unsigned int rate, enum pcm_format format,
+                                  unsigned int period_size,
+                                  unsigned int period_count,
+                                  unsigned int capture_time,
+                                  const struct writer_config *writer_config,
+                                  const struct level_config *level_config);
 
 void sigint_handler(int sig)
 {
@@ -72,39 +143,111 @@ void sigint_handler(int sig)
     }
 }
 
+void sigusr1_handler(int sig)
+{
+    if (sig == SIGUSR1)
+        triggered = 1;
+}
+
+/* Writes the header of a file holding data_sz bytes of audio which start at
+ * data_offset. The header keeps room for a ds64 chunk in a JUNK chunk, which
+ * turns into the ds64 chunk of an RF64 file once the sizes no longer fit in
+ * 32 bits.
+ */
+static int write_wav_header(int fd, const struct wav_header *header,
+                            off_t data_offset, unsigned long long data_sz)
+{
+    char buf[4096];
+    struct chunk_header chunk;
+    unsigned long long riff_sz = data_sz + data_offset - 8;
+    unsigned long long sample_count = data_sz / header->block_align;
+    uint32_t value;
+    ssize_t ret;
+    off_t pos;
+
+    if (data_offset < WAV_HEADER_SIZE || data_offset > (off_t) sizeof(buf))
+        return -1;
+    memset(buf, 0, data_offset);
+
+    value = riff_sz > UINT32_MAX ? ID_RF64 : ID_RIFF;
+    memcpy(buf, &value, 4);
+    value = riff_sz > UINT32_MAX ? UINT32_MAX : riff_sz;
+    memcpy(buf + 4, &value, 4);
+    memcpy(buf + 8, &header->riff_fmt, 4);
+
+    chunk.id = riff_sz > UINT32_MAX ? ID_DS64 : ID_JUNK;
+    chunk.sz = DS64_SIZE;
+    memcpy(buf + 12, &chunk, sizeof(chunk));
+    if (riff_sz > UINT32_MAX) {
+        memcpy(buf + 20, &riff_sz, 8);
+        memcpy(buf + 28, &data_sz, 8);
+        memcpy(buf + 36, &sample_count, 8);
+    }
+    pos = 20 + DS64_SIZE;
+
+    memcpy(buf + pos, &header->fmt_id,
+           offsetof(struct wav_header, data_id) - offsetof(struct wav_header, fmt_id));
+    pos += offsetof(struct wav_header, data_id) - offsetof(struct wav_header, fmt_id);
+
+    /* pad up to data_offset */
+    if (data_offset > WAV_HEADER_SIZE) {
+        chunk.id = ID_JUNK;
+        chunk.sz = data_offset - pos - 2 * sizeof(chunk);
+        memcpy(buf + pos, &chunk, sizeof(chunk));
+    }
+
+    chunk.id = ID_DATA;
+    chunk.sz = data_sz > UINT32_MAX || riff_sz > UINT32_MAX ? UINT32_MAX : data_sz;
+    memcpy(buf + data_offset - sizeof(chunk), &chunk, sizeof(chunk));
+
+    for (pos = 0; pos < data_offset; pos += ret) {
+        ret = pwrite(fd, buf + pos, data_offset - pos, pos);
+        if (ret < 0 && errno == EINTR)
+            ret = 0;
+        else if (ret <= 0)
+            return -1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
-    FILE *file;
     struct wav_header header;
     unsigned int card = 0;
-    unsigned int device = 0;
+    unsigned int devices[CAPTURE_DEVICES_MAX] = { 0 };
+    unsigned int num_devices = 1;
     unsigned int channels = 2;
     unsigned int rate = 48000;
     unsigned int bits = 16;
-    unsigned int frames;
+    unsigned long long frames;
     unsigned int period_size = 1024;
     unsigned int period_count = 4;
     unsigned int capture_time = UINT_MAX;
+    unsigned int segment_time = 0;
+    unsigned int segment_mib = 0;
     enum pcm_format format;
+    unsigned int flags = PCM_IN;
+    struct writer_config writer_config = { 2000, 0, 0, WAV_HEADER_SIZE, NULL, 0, 0, 0, 0 };
+    struct level_config level_config = { 0, 0, 1000 };
+    int level = 0;
+    int pretrigger = 0;
+    char *end;
     int no_header = 0;
 
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s {file.wav | --} [-D card] [-d device] [-c channels] "
-                "[-r rate] [-b bits] [-p period_size] [-n n_periods] [-t time_in_seconds]\n\n"
+        fprintf(stderr, "Usage: %s {file.wav | --} [-D card] [-d device[,device...]] [-c channels] "
+                "[-r rate] [-b bits] [-p period_size] [-n n_periods] [-t time_in_seconds] [-M]\n"
+                "[-B ring_ms] [-O] [-P prealloc_mib] [-S segment_seconds] [-Z segment_mib]\n"
+                "[-T pretrigger_seconds] [-L start_dbfs[,stop_dbfs]] [-H hangover_ms] [--split]\n\n"
                 "Use -- for filename to send raw PCM to stdout\n", argv[0]);
         return 1;
     }
 
     if (strcmp(argv[1],"--") == 0) {
-        file = stdout;
         prinfo = 0;
         no_header = 1;
     } else {
-        file = fopen(argv[1], "wb");
-        if (!file) {
-            fprintf(stderr, "Unable to create file '%s'\n", argv[1]);
-            return 1;
-        }
+        writer_config.filename = argv[1];
     }
 
     /* parse command line arguments */
@@ -112,8 +255,19 @@ int main(int argc, char **argv)
     while (*argv) {
         if (strcmp(*argv, "-d") == 0) {
             argv++;
-            if (*argv)
-                device = atoi(*argv);
+            if (*argv) {
+                /* several devices are captured together */
+                num_devices = 0;
+                end = *argv;
+                do {
+                    if (num_devices == CAPTURE_DEVICES_MAX) {
+                        fprintf(stderr, "At most %d devices can be captured together\n",
+                                CAPTURE_DEVICES_MAX);
+                        return 1;
+                    }
+                    devices[num_devices++] = strtoul(end + (*end == ','), &end, 10);
+                } while (*end == ',');
+            }
         } else if (strcmp(*argv, "-c") == 0) {
             argv++;
             if (*argv)
@@ -142,11 +296,75 @@ int main(int argc, char **argv)
             argv++;
             if (*argv)
                 capture_time = atoi(*argv);
+        } else if (strcmp(*argv, "-M") == 0) {
+            flags |= PCM_MMAP;
+        } else if (strcmp(*argv, "-B") == 0) {
+            argv++;
+            if (*argv)
+                writer_config.ring_time = atoi(*argv);
+        } else if (strcmp(*argv, "-O") == 0) {
+            writer_config.direct = 1;
+        } else if (strcmp(*argv, "-P") == 0) {
+            argv++;
+            if (*argv)
+                writer_config.prealloc = atoi(*argv);
+        } else if (strcmp(*argv, "-S") == 0) {
+            argv++;
+            if (*argv)
+                segment_time = atoi(*argv);
+        } else if (strcmp(*argv, "-Z") == 0) {
+            argv++;
+            if (*argv)
+                segment_mib = atoi(*argv);
+        } else if (strcmp(*argv, "-T") == 0) {
+            argv++;
+            if (*argv)
+                writer_config.pretrigger_time = atoi(*argv);
+            pretrigger = 1;
+        } else if (strcmp(*argv, "-L") == 0) {
+            argv++;
+            if (*argv) {
+                level_config.start = strtof(*argv, &end);
+                level_config.stop = *end == ',' ? strtof(end + 1, NULL) : level_config.start;
+                level = 1;
+            }
+        } else if (strcmp(*argv, "-H") == 0) {
+            argv++;
+            if (*argv)
+                level_config.hangover = atoi(*argv);
+        } else if (strcmp(*argv, "--split") == 0) {
+            writer_config.split = 1;
         }
         if (*argv)
             argv++;
     }
 
+    /* a level starts recording, or else SIGUSR1 does if asked to keep the
+     * audio before it */
+    if (level) {
+        if (!pretrigger)
+            writer_config.pretrigger_time = 1;
+    } else if (writer_config.pretrigger_time > 0) {
+        writer_config.trigger = 1;
+    }
+
+    if (no_header && writer_config.split) {
+        fprintf(stderr, "--split needs a file name\n");
+        return 1;
+    }
+
+    if (num_devices > 1 &&
+        (no_header || (flags & PCM_MMAP) || writer_config.trigger || level)) {
+        fprintf(stderr, "Several devices need a file name, and can not be used "
+                "with -M, -T or -L\n");
+        return 1;
+    }
+
+    if ((flags & PCM_MMAP) && (writer_config.trigger || level)) {
+        fprintf(stderr, "-T and -L can not be used with -M\n");
+        return 1;
+    }
+
     header.riff_id = ID_RIFF;
     header.riff_sz = 0;
     header.riff_fmt = ID_WAVE;
@@ -168,7 +386,6 @@ int main(int argc, char **argv)
         break;
     default:
         fprintf(stderr, "%u bits is not supported.\n", bits);
-        fclose(file);
         return 1;
     }
 
@@ -176,46 +393,1212 @@ int main(int argc, char **argv)
     header.byte_rate = (header.bits_per_sample / 8) * channels * rate;
     header.block_align = channels * (header.bits_per_sample / 8);
     header.data_id = ID_DATA;
+    header.data_sz = 0;
+
+    /* leave enough room for header, direct writes have to start on a
+     * block boundary */
+    if (no_header) {
+        writer_config.data_offset = 0;
+    } else if (writer_config.direct) {
+        writer_config.data_offset = 4096;
+    }
 
-    /* leave enough room for header */
+    /* files are only split when writing files, on the first limit reached */
     if (!no_header) {
-        fseek(file, sizeof(struct wav_header), SEEK_SET);
+        if (segment_time > 0)
+            writer_config.segment_frames = (unsigned long long) segment_time * rate;
+        if (segment_mib > 0 &&
+            (writer_config.segment_frames == 0 ||
+             writer_config.segment_frames > ((unsigned long long) segment_mib << 20) / header.block_align))
+            writer_config.segment_frames = ((unsigned long long) segment_mib << 20) / header.block_align;
+        /* direct writes only split files on whole blocks */
+        if (writer_config.segment_frames > 0 && writer_config.direct &&
+            !(flags & PCM_MMAP)) {
+            writer_config.segment_frames -= writer_config.segment_frames % 4096;
+            if (writer_config.segment_frames == 0)
+                writer_config.segment_frames = 4096;
+        }
     }
 
     /* install signal handler and begin capturing */
     signal(SIGINT, sigint_handler);
-    frames = capture_sample(file, card, device, header.num_channels,
-                            header.sample_rate, format,
-                            period_size, period_count, capture_time);
+    if (writer_config.trigger)
+        signal(SIGUSR1, sigusr1_handler);
+    frames = capture_sample(no_header ? NULL : &header, card, devices,
+                            num_devices, flags,
+                            header.num_channels, header.sample_rate, format,
+                            period_size, period_count, capture_time,
+                            &writer_config, level ? &level_config : NULL);
     if (prinfo) {
-        printf("Captured %u frames\n", frames);
+        printf("Captured %llu frames\n", frames);
     }
 
-    /* write header now all information is known */
-    if (!no_header) {
-        header.data_sz = frames * header.block_align;
-        header.riff_sz = header.data_sz + sizeof(header) - 8;
-        fseek(file, 0, SEEK_SET);
-        fwrite(&header, sizeof(struct wav_header), 1, file);
+    return 0;
+}
+
+/* Eight samples at a time, with the vector extensions of GCC and clang */
+#if defined(__GNUC__) && defined(__has_builtin)
+#if __has_builtin(__builtin_convertvector)
+#define LEVEL_VECTORS
+#endif
+#if __has_builtin(__builtin_shufflevector)
+#define SPLIT_VECTORS
+#endif
+#endif
+
+#if defined(LEVEL_VECTORS) || defined(SPLIT_VECTORS)
+typedef int16_t vec8_s16 __attribute__((vector_size(16)));
+typedef int32_t vec8_s32 __attribute__((vector_size(32)));
+typedef uint32_t vec8_u32 __attribute__((vector_size(32)));
+typedef float vec8_f __attribute__((vector_size(32)));
+#endif
+
+#ifdef SPLIT_VECTORS
+/* Transposes 8 rows of 8 samples in three rounds of interleaving, of
+ * samples, pairs and quads */
+#define SPLIT_TRANSPOSE(r, t)                                                     \
+    do {                                                                          \
+        t[0] = __builtin_shufflevector(r[0], r[1], 0, 8, 1, 9, 2, 10, 3, 11);     \
+        t[1] = __builtin_shufflevector(r[0], r[1], 4, 12, 5, 13, 6, 14, 7, 15);   \
+        t[2] = __builtin_shufflevector(r[2], r[3], 0, 8, 1, 9, 2, 10, 3, 11);     \
+        t[3] = __builtin_shufflevector(r[2], r[3], 4, 12, 5, 13, 6, 14, 7, 15);   \
+        t[4] = __builtin_shufflevector(r[4], r[5], 0, 8, 1, 9, 2, 10, 3, 11);     \
+        t[5] = __builtin_shufflevector(r[4], r[5], 4, 12, 5, 13, 6, 14, 7, 15);   \
+        t[6] = __builtin_shufflevector(r[6], r[7], 0, 8, 1, 9, 2, 10, 3, 11);     \
+        t[7] = __builtin_shufflevector(r[6], r[7], 4, 12, 5, 13, 6, 14, 7, 15);   \
+        r[0] = __builtin_shufflevector(t[0], t[2], 0, 1, 8, 9, 2, 3, 10, 11);     \
+        r[1] = __builtin_shufflevector(t[0], t[2], 4, 5, 12, 13, 6, 7, 14, 15);   \
+        r[2] = __builtin_shufflevector(t[1], t[3], 0, 1, 8, 9, 2, 3, 10, 11);     \
+        r[3] = __builtin_shufflevector(t[1], t[3], 4, 5, 12, 13, 6, 7, 14, 15);   \
+        r[4] = __builtin_shufflevector(t[4], t[6], 0, 1, 8, 9, 2, 3, 10, 11);     \
+        r[5] = __builtin_shufflevector(t[4], t[6], 4, 5, 12, 13, 6, 7, 14, 15);   \
+        r[6] = __builtin_shufflevector(t[5], t[7], 0, 1, 8, 9, 2, 3, 10, 11);     \
+        r[7] = __builtin_shufflevector(t[5], t[7], 4, 5, 12, 13, 6, 7, 14, 15);   \
+        t[0] = __builtin_shufflevector(r[0], r[4], 0, 1, 2, 3, 8, 9, 10, 11);     \
+        t[1] = __builtin_shufflevector(r[0], r[4], 4, 5, 6, 7, 12, 13, 14, 15);   \
+        t[2] = __builtin_shufflevector(r[1], r[5], 0, 1, 2, 3, 8, 9, 10, 11);     \
+        t[3] = __builtin_shufflevector(r[1], r[5], 4, 5, 6, 7, 12, 13, 14, 15);   \
+        t[4] = __builtin_shufflevector(r[2], r[6], 0, 1, 2, 3, 8, 9, 10, 11);     \
+        t[5] = __builtin_shufflevector(r[2], r[6], 4, 5, 6, 7, 12, 13, 14, 15);   \
+        t[6] = __builtin_shufflevector(r[3], r[7], 0, 1, 2, 3, 8, 9, 10, 11);     \
+        t[7] = __builtin_shufflevector(r[3], r[7], 4, 5, 6, 7, 12, 13, 14, 15);   \
+    } while (0)
+
+#define SPLIT_TILE(type, in, channels, out, stride, size)                        \
+    do {                                                                          \
+        type r[8];                                                                \
+        type t[8];                                                                \
+        unsigned int k;                                                           \
+        for (k = 0; k < 8; k++)                                                   \
+            memcpy(&r[k], (in) + k * (channels) * (size), sizeof(type));         \
+        SPLIT_TRANSPOSE(r, t);                                                    \
+        for (k = 0; k < 8; k++)                                                   \
+            memcpy((out) + k * (stride), &t[k], sizeof(type));                   \
+    } while (0)
+#endif
+
+/* The buffer of each channel when split by channel, so each file is written
+ * 64 KiB at a time */
+#define SPLIT_BUFFER_SIZE (64 * 1024)
+
+/* Deinterleaves frames of 16-bit or 32-bit samples, 24-bit samples being
+ * in 32-bit containers, the samples of channel c going to out + c * stride.
+ * Tiles of 8 channels by 8 frames are transposed in registers.
+ */
+static void split_deinterleave(const char *in, unsigned int frames,
+                               unsigned int channels, unsigned int size,
+                               char *out, size_t stride)
+{
+    unsigned int frame = 0;
+    unsigned int c;
+
+#ifdef SPLIT_VECTORS
+    for (; frame + 8 <= frames; frame += 8) {
+        for (c = 0; c + 8 <= channels; c += 8) {
+            if (size == 2)
+                SPLIT_TILE(vec8_s16, in + (frame * channels + c) * 2, channels,
+                           out + c * stride + frame * 2, stride, 2);
+            else
+                SPLIT_TILE(vec8_s32, in + (frame * channels + c) * 4, channels,
+                           out + c * stride + frame * 4, stride, 4);
+        }
+        /* the channels left over */
+        for (; c < channels; c++) {
+            unsigned int k;
+            for (k = frame; k < frame + 8; k++)
+                memcpy(out + c * stride + k * size,
+                       in + (k * channels + c) * size, size);
+        }
+    }
+#endif
+
+    for (; frame < frames; frame++) {
+        for (c = 0; c < channels; c++)
+            memcpy(out + c * stride + frame * size,
+                   in + (frame * channels + c) * size, size);
+    }
+}
+
+/* Writes the audio either to a file, with a header written once the file
+ * is complete, or to stdout. The audio is split into several files if the
+ * size of a file is limited. When split by channel, each channel goes to
+ * its own file, gathered in a buffer first so that each file is written
+ * in large blocks.
+ */
+struct capture_writer {
+    /* the header of the files, NULL to write raw audio to stdout */
+    const struct wav_header *header;
+    const char *filename;
+    /* one file, or one per channel */
+    unsigned int num_files;
+    int *fds;
+    int opened;
+    /* when split by channel, the header of the mono files */
+    struct wav_header split_header;
+    /* the size of a sample when split by channel */
+    unsigned int sample_size;
+    /* num_files buffers of split_size bytes, split_fill of them used */
+    char *split;
+    size_t split_size;
+    size_t split_fill;
+    /* the number of files started */
+    unsigned int segment;
+    /* number the files, as there may be several */
+    int numbered;
+    /* the device in the file names when capturing several, or -1 */
+    int device;
+    /* the number of bytes in a file, zero for no limit */
+    unsigned long long segment_size;
+    /* where the audio starts in the file, zero for a stream */
+    off_t data_offset;
+    /* bypass the page cache */
+    int direct;
+    /* grow the file in steps of this many bytes, zero to disable */
+    off_t prealloc;
+    /* the number of bytes allocated past data_offset, in each file */
+    off_t allocated;
+    /* the number of bytes written to the current files, all of them */
+    unsigned long long file_written;
+    /* the number of bytes written */
+    unsigned long long written;
+};
+
+static void writer_set_direct(struct capture_writer *writer, int direct)
+{
+    unsigned int i;
+    int flags;
+
+    for (i = 0; i < writer->num_files; i++) {
+        flags = fcntl(writer->fds[i], F_GETFL);
+        if (flags < 0)
+            continue;
+        flags = direct ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+        if (fcntl(writer->fds[i], F_SETFL, flags) < 0 && direct) {
+            fprintf(stderr, "O_DIRECT is not supported, using the page cache\n");
+            writer->direct = 0;
+            writer_set_direct(writer, 0);
+            return;
+        }
+    }
+}
+
+static int writer_open_file(struct capture_writer *writer, unsigned int index)
+{
+    const char *filename = writer->filename;
+    const char *ext;
+    char number[16] = "";
+    char device[16] = "";
+    char channel[16] = "";
+    char *name;
+    int fd;
+
+    /* the files of a split capture are numbered, before the extension */
+    if (writer->device >= 0)
+        snprintf(device, sizeof(device), "-dev%d", writer->device);
+    if (writer->numbered)
+        snprintf(number, sizeof(number), "-%04u", writer->segment);
+    if (writer->split)
+        snprintf(channel, sizeof(channel), "-ch%02u", index + 1);
+    ext = strrchr(filename, '.');
+    if (!ext || strchr(ext, '/'))
+        ext = filename + strlen(filename);
+    if (asprintf(&name, "%.*s%s%s%s%s", (int) (ext - filename), filename,
+                 device, number, channel, ext) < 0)
+        return -1;
+
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create file '%s'\n", name);
+        free(name);
+        return -1;
+    }
+    free(name);
+
+    /* an empty header until the size is known */
+    if (write_wav_header(fd, writer->header, writer->data_offset, 0) < 0 ||
+        lseek(fd, writer->data_offset, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int writer_open(struct capture_writer *writer)
+{
+    unsigned int i;
+
+    if (!writer->header) {
+        writer->fds[0] = STDOUT_FILENO;
+        writer->opened = 1;
+        if (writer->direct)
+            writer_set_direct(writer, 1);
+        return 0;
+    }
+
+    for (i = 0; i < writer->num_files; i++) {
+        writer->fds[i] = writer_open_file(writer, i);
+        if (writer->fds[i] < 0) {
+            while (i-- > 0)
+                close(writer->fds[i]);
+            return -1;
+        }
+    }
+
+    writer->opened = 1;
+    writer->segment++;
+    writer->file_written = 0;
+    writer->allocated = 0;
+    writer->split_fill = 0;
+    if (writer->direct)
+        writer_set_direct(writer, 1);
+    return 0;
+}
+
+static int writer_write_fd(int fd, const char *data, size_t size)
+{
+    ssize_t ret;
+
+    while (size > 0) {
+        ret = write(fd, data, size);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return -1;
+        data += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/* Writes what was gathered of each channel to its file */
+static int writer_flush(struct capture_writer *writer)
+{
+    unsigned int i;
+
+    for (i = 0; i < writer->num_files && writer->split_fill > 0; i++) {
+        if (writer_write_fd(writer->fds[i], writer->split + i * writer->split_size,
+                            writer->split_fill) < 0)
+            return -1;
+    }
+    writer->split_fill = 0;
+    return 0;
+}
+
+static int writer_close(struct capture_writer *writer)
+{
+    unsigned int i;
+    int ret = 0;
+
+    if (!writer->opened)
+        return 0;
+    writer->opened = 0;
+
+    /* the header, and the rest of the channels, are not aligned */
+    if (writer->direct)
+        writer_set_direct(writer, 0);
+    if (writer->split && writer_flush(writer) < 0)
+        ret = -1;
+
+    for (i = 0; i < writer->num_files; i++) {
+        if (writer->allocated > 0 &&
+            ftruncate(writer->fds[i], writer->data_offset +
+                      writer->file_written / writer->num_files) < 0)
+            fprintf(stderr, "Unable to release the preallocated space\n");
+
+        if (writer->header) {
+            if (write_wav_header(writer->fds[i], writer->header, writer->data_offset,
+                                 writer->file_written / writer->num_files) < 0)
+                ret = -1;
+            if (close(writer->fds[i]) < 0)
+                ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int writer_write(struct capture_writer *writer, const char *data,
+                        size_t size)
+{
+    unsigned int frame_size = writer->sample_size * writer->num_files;
+    unsigned int frames;
+    unsigned int i;
+    off_t end;
+
+    if (writer->prealloc > 0) {
+        end = (writer->file_written + size) / writer->num_files;
+        if (end > writer->allocated) {
+            /* the files are cut back to the audio written once closed */
+            for (i = 0; i < writer->num_files; i++) {
+                if (fallocate(writer->fds[i], 0, writer->data_offset + writer->allocated,
+                              writer->prealloc) < 0)
+                    break;
+            }
+            if (i == writer->num_files)
+                writer->allocated += writer->prealloc;
+            else
+                writer->prealloc = 0;
+        }
+    }
+
+    if (!writer->split) {
+        if (writer_write_fd(writer->fds[0], data, size) < 0)
+            return -1;
+        writer->file_written += size;
+        writer->written += size;
+        return 0;
+    }
+
+    while (size > 0) {
+        frames = (writer->split_size - writer->split_fill) / writer->sample_size;
+        if (frames > size / frame_size)
+            frames = size / frame_size;
+        split_deinterleave(data, frames, writer->num_files, writer->sample_size,
+                           writer->split + writer->split_fill, writer->split_size);
+        writer->split_fill += frames * writer->sample_size;
+        data += frames * frame_size;
+        size -= frames * frame_size;
+        writer->file_written += frames * frame_size;
+        writer->written += frames * frame_size;
+
+        if (writer->split_fill == writer->split_size && writer_flush(writer) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Writes audio to the current file. Where a file is full the next one is
+ * started, on the exact frame, so no audio is lost in between.
+ */
+static int writer_output(struct capture_writer *writer, const char *data,
+                         size_t size)
+{
+    size_t chunk;
+
+    while (size > 0) {
+        if (!writer->opened && writer_open(writer) < 0)
+            return -1;
+
+        chunk = size;
+        if (writer->segment_size > 0 &&
+            chunk > writer->segment_size - writer->file_written)
+            chunk = writer->segment_size - writer->file_written;
+        if (writer_write(writer, data, chunk) < 0)
+            return -1;
+        data += chunk;
+        size -= chunk;
+
+        if (writer->segment_size > 0 &&
+            writer->file_written == writer->segment_size &&
+            writer_close(writer) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Sets up a writer for the frames of a PCM, split by channel if asked to */
+static int writer_init(struct capture_writer *writer,
+                       const struct wav_header *header,
+                       const struct writer_config *config,
+                       unsigned int channels, unsigned int frame_size,
+                       unsigned int rate)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->header = header;
+    writer->filename = config->filename;
+    writer->device = -1;
+    writer->num_files = config->split ? channels : 1;
+    writer->sample_size = frame_size / channels;
+    writer->fds = calloc(writer->num_files, sizeof(*writer->fds));
+    if (!writer->fds)
+        return -1;
+
+    if (config->split) {
+        writer->split_header = *header;
+        writer->split_header.num_channels = 1;
+        writer->split_header.block_align = writer->sample_size;
+        writer->split_header.byte_rate = writer->sample_size * rate;
+        writer->header = &writer->split_header;
+        writer->split_size = SPLIT_BUFFER_SIZE;
+        if (posix_memalign((void **) &writer->split, 4096,
+                           writer->split_size * channels) != 0) {
+            writer->split = NULL;
+            free(writer->fds);
+            writer->fds = NULL;
+            return -1;
+        }
+    }
+
+    writer->segment_size = config->segment_frames * frame_size;
+    writer->numbered = writer->segment_size > 0;
+    writer->data_offset = config->data_offset;
+    writer->direct = config->direct;
+    writer->prealloc = (off_t) config->prealloc << 20;
+    return 0;
+}
+
+static void writer_free(struct capture_writer *writer)
+{
+    free(writer->split);
+    free(writer->fds);
+}
+
+/* Writes the captured audio straight out of the DMA buffer of a PCM opened
+ * with PCM_MMAP, so it is copied once, from the DMA buffer to the file.
+ * Returns the number of frames captured.
+ */
+static unsigned long long capture_mapped_sample(struct capture_writer *writer,
+                                                struct pcm *pcm,
+                                                unsigned int rate,
+                                                unsigned int capture_time)
+{
+    unsigned long long total_frames_read = 0;
+    unsigned int offset;
+    unsigned int frames;
+    void *areas;
+    char *window;
+    int avail;
+    int ret;
+
+    if (pcm_start(pcm) < 0) {
+        fprintf(stderr, "Unable to start PCM device (%s)\n",
+                pcm_get_error(pcm));
+        return 0;
+    }
+
+    while (capturing) {
+        avail = pcm_avail_update(pcm);
+        if (avail < 0) {
+            fprintf(stderr, "Error capturing sample\n");
+            break;
+        }
+
+        if (avail == 0) {
+            ret = pcm_wait(pcm, -1);
+            if (ret == -EPIPE) {
+                /* overrun, restart the capture */
+                fprintf(stderr, "Overrun, some frames were lost\n");
+                pcm_prepare(pcm);
+                pcm_start(pcm);
+            } else if (ret < 0 && ret != -EINTR) {
+                fprintf(stderr, "Error capturing sample\n");
+                break;
+            }
+            continue;
+        }
+
+        frames = avail;
+        if (capture_time != UINT_MAX &&
+            frames > (unsigned long long) capture_time * rate - total_frames_read) {
+            frames = (unsigned long long) capture_time * rate - total_frames_read;
+        }
+        if (pcm_mmap_begin(pcm, &areas, &offset, &frames) < 0) {
+            fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        window = (char *) areas + pcm_frames_to_bytes(pcm, offset);
+
+        if (writer_output(writer, window, pcm_frames_to_bytes(pcm, frames)) < 0) {
+            fprintf(stderr, "Error writing captured audio (%s)\n", strerror(errno));
+            break;
+        }
+
+        if (pcm_mmap_commit(pcm, offset, frames) < 0) {
+            fprintf(stderr, "Error capturing sample\n");
+            break;
+        }
+
+        total_frames_read += frames;
+        if ((total_frames_read / rate) >= capture_time) {
+            capturing = 0;
+        }
     }
 
-    fclose(file);
+    if (writer_close(writer) < 0)
+        fprintf(stderr, "Error writing the header (%s)\n", strerror(errno));
 
+    return writer->written / pcm_frames_to_bytes(pcm, 1);
+}
+
+/* The captured audio is handed from the capture thread to a writer thread
+ * through a single producer, single consumer ring, so that a slow file
+ * system stalls the writer and not the capture.
+ */
+#define CAPTURE_EVENTS_MAX 64
+
+struct capture_ring {
+    char *data;
+    /* a multiple of block */
+    size_t size;
+    /* the unit of writes, a multiple of the frame size and of 4 KiB */
+    size_t block;
+    /* the number of bytes produced and not consumed yet */
+    atomic_size_t fill;
+    /* set by the capture thread when no more audio is produced */
+    atomic_int done;
+    /* the error number, set by the writer thread if writing failed */
+    atomic_int failed;
+    /* wakes the writer when audio was captured or capture is done */
+    sem_t ready;
+    /* only write between the events sent by the capture thread */
+    int gated;
+    /* before an event starting a recording, the writer keeps this many
+     * bytes */
+    size_t pretrigger;
+    /* where recordings start and stop, alternately, as offsets in the
+     * captured stream */
+    unsigned long long events[CAPTURE_EVENTS_MAX];
+    /* the number of events sent, and handled by the writer */
+    atomic_uint events_head;
+    atomic_uint events_tail;
+    /* where the capture thread writes next */
+    size_t write_index;
+    /* capture thread statistics */
+    size_t high_water;
+    unsigned int overruns;
+    unsigned long long dropped_frames;
+};
+
+struct capture_thread {
+    struct capture_ring ring;
+    struct capture_writer *writer;
+    pthread_t thread;
+    /* when the PCM was started */
+    struct timespec trigger;
+};
+
+static int capture_ring_init(struct capture_ring *ring, size_t block,
+                             size_t size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->block = block;
+    ring->size = (size + block - 1) / block * block;
+    if (ring->size < 4 * block)
+        ring->size = 4 * block;
+
+    if (posix_memalign((void **) &ring->data, 4096, ring->size) != 0)
+        return -1;
+    /* fault the ring in now rather than in the capture loop */
+    memset(ring->data, 0, ring->size);
+
+    atomic_init(&ring->fill, 0);
+    atomic_init(&ring->done, 0);
+    atomic_init(&ring->failed, 0);
+    atomic_init(&ring->events_head, 0);
+    atomic_init(&ring->events_tail, 0);
+    if (sem_init(&ring->ready, 0, 0) != 0) {
+        free(ring->data);
+        return -1;
+    }
     return 0;
 }
 
-unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
-                            unsigned int channels, unsigned int rate,
-                            enum pcm_format format, unsigned int period_size,
-                            unsigned int period_count, unsigned int capture_time)
+static void capture_ring_free(struct capture_ring *ring)
+{
+    sem_destroy(&ring->ready);
+    free(ring->data);
+}
+
+/* Sends an event to the writer, unless it is too far behind to take it */
+static int capture_ring_event(struct capture_ring *ring,
+                              unsigned long long offset)
+{
+    unsigned int head = atomic_load_explicit(&ring->events_head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&ring->events_tail, memory_order_acquire) >= CAPTURE_EVENTS_MAX)
+        return 0;
+    ring->events[head % CAPTURE_EVENTS_MAX] = offset;
+    atomic_store_explicit(&ring->events_head, head + 1, memory_order_release);
+    return 1;
+}
+
+/* Returns how many whole frames, up to max, fit in the ring from where the
+ * capture writes next. The ring never splits a frame at its end.
+ */
+static unsigned int capture_ring_space(struct capture_ring *ring,
+                                       unsigned int frame_size,
+                                       unsigned int max)
+{
+    size_t space;
+
+    space = ring->size - atomic_load_explicit(&ring->fill, memory_order_acquire);
+    if (space > ring->size - ring->write_index)
+        space = ring->size - ring->write_index;
+
+    return space / frame_size < max ? space / frame_size : max;
+}
+
+/* Hands size bytes captured at the write index to the writer */
+static void capture_ring_commit(struct capture_ring *ring, size_t size)
+{
+    size_t fill;
+
+    ring->write_index = (ring->write_index + size) % ring->size;
+    fill = atomic_fetch_add_explicit(&ring->fill, size, memory_order_release);
+    /* the writer also waits for events, wake it every period */
+    sem_post(&ring->ready);
+    if (fill + size > ring->high_water)
+        ring->high_water = fill + size;
+}
+
+/* Reads a period into scratch and drops it, while the writer is behind and
+ * the ring is full, so that the PCM itself keeps running.
+ * Returns the number of frames dropped, or a negative number on error.
+ */
+static int capture_ring_drop(struct capture_ring *ring, struct pcm *pcm,
+                             char *scratch, unsigned int period_size,
+                             int dropping)
+{
+    int ret;
+
+    if (!dropping)
+        ring->overruns++;
+    ret = pcm_readi(pcm, scratch, period_size);
+    if (ret < 0) {
+        fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcm));
+        return ret;
+    }
+    ring->dropped_frames += ret;
+    return ret;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct capture_thread *capture = arg;
+    struct capture_ring *ring = &capture->ring;
+    struct capture_writer *writer = capture->writer;
+    unsigned long long consumed = 0;
+    unsigned long long start;
+    unsigned long long stop;
+    unsigned int event = 0;
+    int recording = !ring->gated;
+    size_t read_index = 0;
+    size_t fill;
+    size_t size;
+    int done;
+
+    for (;;) {
+        done = atomic_load_explicit(&ring->done, memory_order_acquire);
+        fill = atomic_load_explicit(&ring->fill, memory_order_acquire);
+
+        if (!recording) {
+            if (event != atomic_load_explicit(&ring->events_head, memory_order_acquire)) {
+                /* start with the audio kept from before the event, direct
+                 * writes from a whole block */
+                start = ring->events[event % CAPTURE_EVENTS_MAX];
+                start = start > ring->pretrigger ? start - ring->pretrigger : 0;
+                size = start > consumed ? start - consumed : 0;
+                if (writer->direct)
+                    size -= size % ring->block;
+                recording = 1;
+                atomic_store_explicit(&ring->events_tail, ++event, memory_order_release);
+            } else if (done) {
+                break;
+            } else if (fill >= ring->pretrigger + ring->block) {
+                /* drop what is older than the pre-trigger time */
+                size = (fill - ring->pretrigger) / ring->block * ring->block;
+            } else {
+                sem_wait(&ring->ready);
+                continue;
+            }
+            read_index = (read_index + size) % ring->size;
+            consumed += size;
+            atomic_fetch_sub_explicit(&ring->fill, size, memory_order_release);
+            continue;
+        }
+
+        /* write up to the event stopping the recording, direct writes up to
+         * the end of its block */
+        stop = ULLONG_MAX;
+        if (event != atomic_load_explicit(&ring->events_head, memory_order_acquire)) {
+            stop = ring->events[event % CAPTURE_EVENTS_MAX];
+            if (writer->direct)
+                stop = (stop + ring->block - 1) / ring->block * ring->block;
+            if (consumed >= stop) {
+                if (writer_close(writer) < 0) {
+                    atomic_store_explicit(&ring->failed, errno ? errno : EIO,
+                                          memory_order_release);
+                    break;
+                }
+                recording = 0;
+                atomic_store_explicit(&ring->events_tail, ++event, memory_order_release);
+                continue;
+            }
+        }
+
+        if (fill < ring->block && consumed + fill < stop && !done) {
+            sem_wait(&ring->ready);
+            continue;
+        }
+        if (fill == 0)
+            break;
+
+        /* up to the end of the ring, direct writes in whole blocks */
+        size = ring->size - read_index;
+        if (fill < size)
+            size = fill;
+        if (stop - consumed < size)
+            size = stop - consumed;
+        if (writer->direct) {
+            if (size >= ring->block) {
+                size -= size % ring->block;
+            } else {
+                /* the tail is not aligned, write it through the page cache */
+                writer->direct = 0;
+                if (writer->opened)
+                    writer_set_direct(writer, 0);
+            }
+        }
+
+        if (writer_output(writer, ring->data + read_index, size) < 0) {
+            atomic_store_explicit(&ring->failed, errno ? errno : EIO,
+                                  memory_order_release);
+            break;
+        }
+
+        read_index = (read_index + size) % ring->size;
+        consumed += size;
+        atomic_fetch_sub_explicit(&ring->fill, size, memory_order_release);
+    }
+
+    if (writer_close(writer) < 0 &&
+        atomic_load_explicit(&ring->failed, memory_order_acquire) == 0)
+        atomic_store_explicit(&ring->failed, errno ? errno : EIO,
+                              memory_order_release);
+
+    return NULL;
+}
+
+/* The peak and the energy of a period, in sample units */
+struct level {
+    int32_t peak;
+    float energy;
+};
+
+/* Measures interleaved samples in 16-bit or 32-bit containers, eight at a
+ * time where the compiler has vector extensions. The peak is one below the
+ * magnitude of negative samples, x ^ (x >> 31) never overflows.
+ */
+static void level_measure(const char *data, unsigned int samples,
+                          enum pcm_format format, struct level *level)
+{
+    unsigned int shift = format == PCM_FORMAT_S24_LE ? 8 : 0;
+    unsigned int i = 0;
+    int32_t peak = 0;
+    float energy = 0;
+    int16_t x16;
+    int32_t x;
+#ifdef LEVEL_VECTORS
+    unsigned int lane;
+    vec8_s32 vpeak = { 0 };
+    vec8_f venergy = { 0 };
+    vec8_s16 v16;
+    vec8_s32 v;
+    vec8_s32 mask;
+    vec8_f f;
+
+    for (; i + 8 <= samples; i += 8) {
+        if (format == PCM_FORMAT_S16_LE) {
+            memcpy(&v16, data + i * 2, sizeof(v16));
+            v = __builtin_convertvector(v16, vec8_s32);
+        } else {
+            memcpy(&v, data + i * 4, sizeof(v));
+            /* sign extend 24-bit samples */
+            v = (vec8_s32) ((vec8_u32) v << shift) >> shift;
+        }
+        f = __builtin_convertvector(v, vec8_f);
+        venergy += f * f;
+        v ^= v >> 31;
+        mask = v > vpeak;
+        vpeak = (v & mask) | (vpeak & ~mask);
+    }
+    for (lane = 0; lane < 8; lane++) {
+        if (vpeak[lane] > peak)
+            peak = vpeak[lane];
+        energy += venergy[lane];
+    }
+#endif
+
+    for (; i < samples; i++) {
+        if (format == PCM_FORMAT_S16_LE) {
+            memcpy(&x16, data + i * 2, sizeof(x16));
+            x = x16;
+        } else {
+            memcpy(&x, data + i * 4, sizeof(x));
+            x = (int32_t) ((uint32_t) x << shift) >> shift;
+        }
+        energy += (float) x * x;
+        x ^= x >> 31;
+        if (x > peak)
+            peak = x;
+    }
+
+    level->peak = peak;
+    level->energy = energy;
+}
+
+/* Opens and closes the recording on the levels of the captured periods */
+struct level_gate {
+    /* in sample units */
+    float start_peak;
+    float stop_energy;
+    unsigned int hangover;
+    /* the number of frames below the stop level */
+    unsigned int quiet;
+    int open;
+};
+
+static void level_gate_init(struct level_gate *gate,
+                            const struct level_config *config,
+                            enum pcm_format format, unsigned int rate)
+{
+    float full_scale;
+    float stop;
+
+    /* 24-bit samples are in 32-bit containers */
+    if (format == PCM_FORMAT_S24_LE)
+        full_scale = 1u << 23;
+    else
+        full_scale = 1u << (pcm_format_to_bits(format) - 1);
+    stop = full_scale * powf(10.0f, config->stop / 20.0f);
+    gate->start_peak = full_scale * powf(10.0f, config->start / 20.0f);
+    gate->stop_energy = stop * stop;
+    gate->hangover = (unsigned long long) config->hangover * rate / 1000;
+    gate->quiet = 0;
+    gate->open = 0;
+}
+
+/* Tells the writer threads that capture is done, waits for them and reports
+ * their errors.
+ */
+static void capture_threads_stop(struct capture_thread *captures,
+                                 unsigned int count)
+{
+    struct capture_ring *ring;
+    unsigned int i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        ring = &captures[i].ring;
+        atomic_store_explicit(&ring->done, 1, memory_order_release);
+        sem_post(&ring->ready);
+        pthread_join(captures[i].thread, NULL);
+
+        ret = atomic_load(&ring->failed);
+        if (ret != 0)
+            fprintf(stderr, "Error writing captured audio (%s)\n", strerror(ret));
+        if (ring->gated && atomic_load(&ring->events_head) == 0)
+            fprintf(stderr, "The capture was never triggered, nothing was written\n");
+    }
+}
+
+/* Starts a writer thread for each capture and allocates a period of scratch
+ * space for dropping audio. The calling thread, which captures, runs at
+ * real-time priority from then on if allowed to, the writers keep the
+ * default policy.
+ * Returns the scratch space, or NULL with no thread left running.
+ */
+static char *capture_threads_start(struct capture_thread *captures,
+                                   unsigned int count, struct pcm *pcm)
+{
+    unsigned int size = pcm_frames_to_bytes(pcm, pcm_get_config(pcm)->period_size);
+    struct sched_param param;
+    unsigned int started;
+    char *scratch;
+
+    scratch = malloc(size);
+    if (!scratch) {
+        fprintf(stderr, "Unable to allocate %u bytes\n", size);
+        return NULL;
+    }
+
+    for (started = 0; started < count; started++) {
+        if (pthread_create(&captures[started].thread, NULL, writer_thread,
+                           &captures[started]) != 0) {
+            fprintf(stderr, "Unable to start the writer thread\n");
+            capture_threads_stop(captures, started);
+            free(scratch);
+            return NULL;
+        }
+    }
+
+    param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    return scratch;
+}
+
+/* Captures into the ring while the writer thread drains it to the file.
+ * If the writer falls behind and the ring is full, captured periods are
+ * dropped rather than left in the PCM. The PCM may still overrun if this
+ * thread is late; pcm_readi() then restarts it and counts the xrun.
+ * Returns the number of frames written to the file.
+ */
+static unsigned long long capture_to_ring(struct capture_thread *capture,
+                                          struct pcm *pcm, unsigned int rate,
+                                          unsigned int capture_time,
+                                          struct level_gate *gate)
+{
+    struct capture_ring *ring = &capture->ring;
+    const struct pcm_config *config = pcm_get_config(pcm);
+    unsigned int frame_size = pcm_frames_to_bytes(pcm, 1);
+    unsigned int period_size = config->period_size;
+    unsigned long long total_frames_read = 0;
+    unsigned long long produced = 0;
+    unsigned long long remaining;
+    struct level level;
+    size_t size;
+    unsigned int frames;
+    int trigger_sent = 0;
+    int dropping = 0;
+    char *scratch;
+    char *data;
+    int ret;
+
+    scratch = capture_threads_start(capture, 1, pcm);
+    if (!scratch)
+        return 0;
+
+    while (capturing && !atomic_load_explicit(&ring->failed, memory_order_acquire)) {
+        frames = capture_ring_space(ring, frame_size, period_size);
+        if (capture_time != UINT_MAX) {
+            remaining = (unsigned long long) capture_time * rate - total_frames_read;
+            if (remaining == 0)
+                break;
+            if (frames > remaining)
+                frames = remaining;
+        }
+
+        if (frames == 0) {
+            if (capture_ring_drop(ring, pcm, scratch, period_size, dropping) < 0)
+                break;
+            dropping = 1;
+            continue;
+        }
+        dropping = 0;
+
+        data = ring->data + ring->write_index;
+        ret = pcm_readi(pcm, data, frames);
+        if (ret < 0) {
+            fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcm));
+            break;
+        }
+        size = (size_t) ret * frame_size;
+
+        /* events are sent before the audio, so the writer never drops what
+         * precedes them */
+        if (ring->gated && !gate && triggered && !trigger_sent)
+            trigger_sent = capture_ring_event(ring, produced);
+        if (gate) {
+            level_measure(data, ret * config->channels, config->format, &level);
+            if (!gate->open) {
+                /* the recording starts with the period reaching the level */
+                if (level.peak >= gate->start_peak &&
+                    capture_ring_event(ring, produced)) {
+                    gate->open = 1;
+                    gate->quiet = 0;
+                }
+            } else {
+                if (level.energy >= gate->stop_energy * ret * config->channels)
+                    gate->quiet = 0;
+                else
+                    gate->quiet += ret;
+                if (gate->quiet >= gate->hangover &&
+                    capture_ring_event(ring, produced + size))
+                    gate->open = 0;
+            }
+        }
+
+        capture_ring_commit(ring, size);
+        produced += size;
+        total_frames_read += ret;
+    }
+
+    capture_threads_stop(capture, 1);
+
+    free(scratch);
+    return capture->writer->written / frame_size;
+}
+
+/* Captures from several PCMs, linked so that they start together, in one
+ * loop. The same frames are read from every PCM once all of them have a
+ * period, and dropped from every PCM if a ring is full, so that the files
+ * stay aligned to the frame.
+ * Returns the number of frames written to each file.
+ */
+static unsigned long long capture_linked(struct capture_thread *captures,
+                                         struct pcm **pcms, unsigned int count,
+                                         unsigned int rate,
+                                         unsigned int capture_time)
+{
+    unsigned int frame_size = pcm_frames_to_bytes(pcms[0], 1);
+    unsigned int period_size = pcm_get_config(pcms[0])->period_size;
+    struct pollfd pfds[CAPTURE_DEVICES_MAX];
+    unsigned long long total_frames_read = 0;
+    unsigned long long remaining;
+    struct capture_ring *ring;
+    unsigned int frames;
+    unsigned int shortest;
+    unsigned int nfds;
+    unsigned int i;
+    int dropping = 0;
+    char *scratch;
+    int avail;
+    int ret;
+
+    scratch = capture_threads_start(captures, count, pcms[0]);
+    if (!scratch)
+        return 0;
+
+    for (i = 1; i < count; i++) {
+        if (pcm_link(pcms[0], pcms[i]) < 0) {
+            fprintf(stderr, "Unable to link PCM devices (%s)\n",
+                    pcm_get_error(pcms[0]));
+            goto out;
+        }
+    }
+    if (pcm_start(pcms[0]) < 0) {
+        fprintf(stderr, "Unable to start PCM devices (%s)\n",
+                pcm_get_error(pcms[0]));
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (pcm_get_trigger_timestamp(pcms[i], &captures[i].trigger) < 0)
+            fprintf(stderr, "Unable to get the start time of device %d (%s)\n",
+                    captures[i].writer->device, pcm_get_error(pcms[i]));
+        else
+            fprintf(prinfo ? stdout : stderr, "Device %d started at %lld.%09ld\n",
+                    captures[i].writer->device,
+                    (long long) captures[i].trigger.tv_sec,
+                    captures[i].trigger.tv_nsec);
+    }
+
+    while (capturing) {
+        /* wait for the PCMs with less than a period */
+        nfds = 0;
+        for (i = 0; i < count; i++) {
+            avail = pcm_avail_update(pcms[i]);
+            if (avail < 0 || pcm_state(pcms[i]) == PCM_STATE_XRUN) {
+                fprintf(stderr, "Overrun on device %d, the files are no longer aligned\n",
+                        captures[i].writer->device);
+                goto out;
+            }
+            if ((unsigned int) avail < period_size) {
+                pfds[nfds].fd = pcm_get_file_descriptor(pcms[i]);
+                pfds[nfds].events = POLLIN;
+                nfds++;
+            }
+        }
+        if (nfds > 0) {
+            if (poll(pfds, nfds, -1) < 0 && errno != EINTR) {
+                fprintf(stderr, "Error waiting for PCM devices (%s)\n", strerror(errno));
+                break;
+            }
+            continue;
+        }
+
+        /* every ring takes the same frames */
+        frames = period_size;
+        for (i = 0; i < count; i++) {
+            ring = &captures[i].ring;
+            if (atomic_load_explicit(&ring->failed, memory_order_acquire))
+                goto out;
+            frames = capture_ring_space(ring, frame_size, frames);
+        }
+        if (capture_time != UINT_MAX) {
+            remaining = (unsigned long long) capture_time * rate - total_frames_read;
+            if (remaining == 0)
+                break;
+            if (frames > remaining)
+                frames = remaining;
+        }
+
+        if (frames == 0) {
+            /* a writer is behind, drop a period of every PCM */
+            for (i = 0; i < count; i++) {
+                if (capture_ring_drop(&captures[i].ring, pcms[i], scratch,
+                                      period_size, dropping) < 0)
+                    goto out;
+            }
+            dropping = 1;
+            continue;
+        }
+        dropping = 0;
+
+        shortest = frames;
+        for (i = 0; i < count; i++) {
+            ring = &captures[i].ring;
+            ret = pcm_readi(pcms[i], ring->data + ring->write_index, frames);
+            if (ret < 0) {
+                fprintf(stderr, "Error capturing sample (%s)\n", pcm_get_error(pcms[i]));
+                goto out;
+            }
+            if ((unsigned int) ret < shortest)
+                shortest = ret;
+        }
+
+        /* the files keep only the frames read from every PCM, a short read
+         * ends the capture there */
+        for (i = 0; i < count; i++)
+            capture_ring_commit(&captures[i].ring, (size_t) shortest * frame_size);
+        total_frames_read += shortest;
+        if (shortest < frames)
+            break;
+    }
+
+out:
+    capture_threads_stop(captures, count);
+    for (i = 1; i < count; i++)
+        pcm_unlink(pcms[i]);
+
+    free(scratch);
+    return captures[0].writer->written / frame_size;
+}
+
+unsigned long long capture_sample(const struct wav_header *header,
+                                  unsigned int card,
+                                  const unsigned int *devices,
+                                  unsigned int num_devices,
+                                  unsigned int flags, unsigned int channels,
+                                  unsigned int rate, enum pcm_format format,
+                                  unsigned int period_size,
+                                  unsigned int period_count,
+                                  unsigned int capture_time,
+                                  const struct writer_config *writer_config,
+                                  const struct level_config *level_config)
 {
     struct pcm_config config;
-    struct pcm *pcm;
-    char *buffer;
-    unsigned int size;
-    unsigned int frames_read;
-    unsigned int total_frames_read;
-    unsigned int bytes_per_frame;
+    struct pcm *pcms[CAPTURE_DEVICES_MAX] = { NULL };
+    struct capture_writer writers[CAPTURE_DEVICES_MAX];
+    struct capture_thread captures[CAPTURE_DEVICES_MAX];
+    struct level_gate gate;
+    unsigned long long total_frames_read = 0;
+    unsigned int num_writers = 0;
+    unsigned int num_rings = 0;
+    unsigned int frame_size = 0;
+    unsigned int i;
+    size_t ring_size;
+    int gated = writer_config->trigger || level_config;
 
     memset(&config, 0, sizeof(config));
     config.channels = channels;
@@ -227,19 +1610,40 @@ unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
     config.stop_threshold = 0;
     config.silence_threshold = 0;
 
-    pcm = pcm_open(card, device, PCM_IN, &config);
-    if (!pcm || !pcm_is_ready(pcm)) {
-        fprintf(stderr, "Unable to open PCM device (%s)\n",
-                pcm_get_error(pcm));
-        return 0;
-    }
+    /* xruns stop linked PCMs, which are then no longer aligned, and the
+     * trigger time stamps of several devices are compared */
+    if (num_devices > 1)
+        flags |= PCM_NORESTART | PCM_MONOTONIC;
 
-    size = pcm_frames_to_bytes(pcm, pcm_get_buffer_size(pcm));
-    buffer = malloc(size);
-    if (!buffer) {
-        fprintf(stderr, "Unable to allocate %u bytes\n", size);
-        pcm_close(pcm);
-        return 0;
+    for (i = 0; i < num_devices; i++) {
+        pcms[i] = pcm_open(card, devices[i], flags, &config);
+        if (!pcms[i] || !pcm_is_ready(pcms[i])) {
+            fprintf(stderr, "Unable to open PCM device %u (%s)\n",
+                    devices[i], pcm_get_error(pcms[i]));
+            goto out;
+        }
+
+        frame_size = pcm_frames_to_bytes(pcms[i], 1);
+        if (writer_init(&writers[i], header, writer_config, channels,
+                        frame_size, rate) < 0) {
+            fprintf(stderr, "Unable to allocate the writer\n");
+            goto out;
+        }
+        num_writers++;
+        /* each device has its own files, a level may start several
+         * recordings */
+        if (num_devices > 1)
+            writers[i].device = devices[i];
+        if (level_config)
+            writers[i].numbered = 1;
+        /* the DMA buffer is not aligned for direct writes */
+        if (flags & PCM_MMAP)
+            writers[i].direct = 0;
+
+        /* unless waiting for a trigger, fail before capturing anything if
+         * the file can not be created */
+        if (!gated && writer_open(&writers[i]) < 0)
+            goto out;
     }
 
     if (prinfo) {
@@ -247,23 +1651,63 @@ unsigned int capture_sample(FILE *file, unsigned int card, unsigned int device,
            pcm_format_to_bits(format));
     }
 
-    bytes_per_frame = pcm_frames_to_bytes(pcm, 1);
-    total_frames_read = 0;
-    frames_read = 0;
-    while (capturing) {
-        frames_read = pcm_readi(pcm, buffer, pcm_get_buffer_size(pcm));
-        total_frames_read += frames_read;
-        if ((total_frames_read / rate) >= capture_time) {
-            capturing = 0;
-        }
-        if (fwrite(buffer, bytes_per_frame, frames_read, file) != frames_read) {
-            fprintf(stderr,"Error capturing sample\n");
-            break;
+    if (flags & PCM_MMAP) {
+        total_frames_read = capture_mapped_sample(&writers[0], pcms[0], rate,
+                                                  capture_time);
+        goto out;
+    }
+
+    /* writes are whole frames and whole 4 KiB pages, the ring also holds the
+     * audio kept before the trigger */
+    memset(captures, 0, sizeof(captures));
+    ring_size = (size_t) writer_config->ring_time * rate / 1000 * frame_size;
+    if (gated)
+        ring_size += (size_t) writer_config->pretrigger_time * rate * frame_size;
+    for (i = 0; i < num_devices; i++) {
+        if (capture_ring_init(&captures[i].ring, 4096 * frame_size, ring_size) < 0) {
+            fprintf(stderr, "Unable to allocate the capture ring\n");
+            goto out;
         }
+        num_rings++;
+        captures[i].ring.gated = gated;
+        if (gated)
+            captures[i].ring.pretrigger = (size_t) writer_config->pretrigger_time * rate * frame_size;
+        captures[i].writer = &writers[i];
+    }
+
+    if (num_devices > 1) {
+        total_frames_read = capture_linked(captures, pcms, num_devices, rate,
+                                           capture_time);
+    } else {
+        if (level_config)
+            level_gate_init(&gate, level_config, format, rate);
+        total_frames_read = capture_to_ring(&captures[0], pcms[0], rate,
+                                            capture_time,
+                                            level_config ? &gate : NULL);
     }
 
-    free(buffer);
-    pcm_close(pcm);
+    for (i = 0; i < num_devices; i++) {
+        if (num_devices > 1)
+            fprintf(prinfo ? stdout : stderr, "Device %u ", devices[i]);
+        fprintf(prinfo ? stdout : stderr,
+                "Ring: %zu KiB, high-water %zu KiB (%zu%%), %u overruns, %llu frames dropped, "
+                "PCM: %u xruns\n",
+                captures[i].ring.size >> 10, captures[i].ring.high_water >> 10,
+                captures[i].ring.high_water * 100 / captures[i].ring.size,
+                captures[i].ring.overruns, captures[i].ring.dropped_frames,
+                pcm_get_xruns(pcms[i]));
+    }
+
+out:
+    for (i = 0; i < num_rings; i++)
+        capture_ring_free(&captures[i].ring);
+    for (i = 0; i < num_writers; i++) {
+        writer_close(&writers[i]);
+        writer_free(&writers[i]);
+    }
+    for (i = 0; i < num_devices; i++) {
+        if (pcms[i])
+            pcm_close(pcms[i]);
+    }
     return total_frames_read;
 }
-
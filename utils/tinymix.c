@@ -34,15 +34,75 @@
 #include <ctype.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
-static void tinymix_list_controls(struct mixer *mixer, int print_all);
+#define SCRIPT_LINE_MAX 4096
+#define SCRIPT_ARGS_MAX 256
 
-static void tinymix_detail_control(struct mixer *mixer, const char *control);
+enum tinymix_format {
+    TINYMIX_FORMAT_PLAIN,
+    TINYMIX_FORMAT_JSON,
+    TINYMIX_FORMAT_TSV,
+};
 
-static void tinymix_set_value(struct mixer *mixer, const char *control,
-                              char **values, unsigned int num_values);
+/* The values of a control, read with a single ioctl. */
+struct tinymix_values {
+    enum mixer_ctl_type type;
+    unsigned int count;
+    int *ints;
+    long long *ints64;
+    unsigned char *bytes;
+    struct mixer_iec958 iec958;
+};
+
+#define MONITOR_EVENTS_MAX 64
+
+/* monitor flags of a control */
+#define MONITOR_WATCHED 0x01
+#define MONITOR_PENDING 0x02
+#define MONITOR_REMOVED 0x04
+
+/* The state of tinymix monitor. */
+struct tinymix_monitor {
+    struct mixer *mixer;
+    int watch_all;
+    unsigned int num_ctls;
+    /* the last values seen, per control */
+    struct tinymix_values *values;
+    unsigned char *flags;
+    /* the controls that had events in the current batch */
+    unsigned int *pending_ids;
+    unsigned int num_pending;
+};
+
+static enum tinymix_format output_format = TINYMIX_FORMAT_PLAIN;
+
+static void tinymix_list_controls(struct mixer *mixer, int print_all,
+                                  const char *pattern);
+
+static int tinymix_detail_control(struct mixer *mixer, const char *control);
+
+static int tinymix_set_value(struct mixer *mixer, const char *control,
+                             char **values, unsigned int num_values);
+
+static int tinymix_print_ctl(struct mixer_ctl *ctl, unsigned int id,
+                             int print_values, int print_header);
 
-static void tinymix_print_enum(struct mixer_ctl *ctl);
+static void tinymix_free_values(struct tinymix_values *values);
+
+static int tinymix_monitor(struct mixer *mixer, char **controls,
+                           unsigned int num_controls);
+
+static int tinymix_stage_value(struct mixer *mixer,
+                               struct mixer_transaction *transaction,
+                               const char *control, char **values,
+                               unsigned int num_values);
+
+static int tinymix_run_command(struct mixer *mixer,
+                               struct mixer_transaction *transaction,
+                               int argc, char **argv);
+
+static int tinymix_run_script(struct mixer *mixer, const char *filename);
 
 void usage(void)
 {
@@ -51,11 +111,15 @@ void usage(void)
     printf("\t-h, --help        : prints this help message and exits\n");
     printf("\t-v, --version     : prints this version of tinymix and exits\n");
     printf("\t-D, --card NUMBER : specifies the card number of the mixer\n");
+    printf("\t-f, --file FILE   : runs the commands in FILE, one per line\n");
+    printf("\t-F, --format FMT  : prints controls as plain (default), json or tsv\n");
     printf("commands:\n");
     printf("\tget NAME|ID       : prints the values of a control\n");
     printf("\tset NAME|ID VALUE : sets the value of a control\n");
-    printf("\tcontrols          : lists controls of the mixer\n");
-    printf("\tcontents          : lists controls of the mixer and their contents\n");
+    printf("\tcontrols [PATTERN]: lists controls of the mixer\n");
+    printf("\tcontents [PATTERN]: lists controls of the mixer and their contents\n");
+    printf("\tmonitor [NAME|ID] : prints the changes of controls as they happen\n");
+    printf("\t-                 : runs the commands read from the standard input\n");
 }
 
 void version(void)
@@ -67,12 +131,16 @@ int main(int argc, char **argv)
 {
     struct mixer *mixer;
     int card = 0;
-    char *cmd;
+    const char *script = NULL;
+    int ret;
 
     while (1) {
         static struct option long_options[] = {
-            { "version", no_argument, NULL, 'v' },
-            { "help",    no_argument, NULL, 'h' },
+            { "version", no_argument,       NULL, 'v' },
+            { "help",    no_argument,       NULL, 'h' },
+            { "card",    required_argument, NULL, 'D' },
+            { "file",    required_argument, NULL, 'f' },
+            { "format",  required_argument, NULL, 'F' },
             { 0, 0, 0, 0 }
         };
 
@@ -80,7 +148,7 @@ int main(int argc, char **argv)
         int option_index = 0;
         int c = 0;
 
-        c = getopt_long (argc, argv, "c:D:hv", long_options, &option_index);
+        c = getopt_long (argc, argv, "c:D:f:F:hv", long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1)
@@ -90,6 +158,21 @@ int main(int argc, char **argv)
         case 'D':
             card = atoi(optarg);
             break;
+        case 'f':
+            script = optarg;
+            break;
+        case 'F':
+            if (strcmp(optarg, "plain") == 0) {
+                output_format = TINYMIX_FORMAT_PLAIN;
+            } else if (strcmp(optarg, "json") == 0) {
+                output_format = TINYMIX_FORMAT_JSON;
+            } else if (strcmp(optarg, "tsv") == 0) {
+                output_format = TINYMIX_FORMAT_TSV;
+            } else {
+                fprintf(stderr, "unknown format '%s' (see --help)\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         case 'h':
             usage();
             return EXIT_SUCCESS;
@@ -105,168 +188,874 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    cmd = argv[optind];
-    if (cmd == NULL) {
+    if (!script && (optind < argc) && !strcmp(argv[optind], "-"))
+        script = "-";
+
+    if (script) {
+        ret = tinymix_run_script(mixer, script);
+    } else if (optind >= argc) {
         fprintf(stderr, "no command specified (see --help)\n");
-        mixer_close(mixer);
-        return EXIT_FAILURE;
-    } else if (strcmp(cmd, "get") == 0) {
-        if ((optind + 1) >= argc) {
-            fprintf(stderr, "no control specified\n");
-            mixer_close(mixer);
-            return EXIT_FAILURE;
-        }
-        tinymix_detail_control(mixer, argv[optind + 1]);
-        printf("\n");
-    } else if (strcmp(cmd, "set") == 0) {
-        if ((optind + 1) >= argc) {
+        ret = -1;
+    } else {
+        ret = tinymix_run_command(mixer, NULL, argc - optind, &argv[optind]);
+    }
+
+    mixer_close(mixer);
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static struct mixer_ctl *tinymix_get_ctl(struct mixer *mixer,
+                                         const char *control)
+{
+    if (isdigit(control[0]))
+        return mixer_get_ctl(mixer, atoi(control));
+    else
+        return mixer_get_ctl_by_name(mixer, control);
+}
+
+/* Runs a single command. If transaction is not NULL, set commands that
+ * only write integer, boolean or enumerated values are staged in it instead
+ * of being written right away; the caller commits it. Other set commands
+ * are not run, so that the caller can commit the values staged before them.
+ * Returns 0 on success, 1 if a set command was not staged, -1 on failure.
+ */
+static int tinymix_run_command(struct mixer *mixer,
+                               struct mixer_transaction *transaction,
+                               int argc, char **argv)
+{
+    const char *cmd = argv[0];
+    int ret;
+
+    if (strcmp(cmd, "set") == 0) {
+        if (argc < 2) {
             fprintf(stderr, "no control specified\n");
-            mixer_close(mixer);
-            return EXIT_FAILURE;
+            return -1;
         }
-        if ((optind + 2) >= argc) {
+        if (argc < 3) {
             fprintf(stderr, "no value(s) specified\n");
-            mixer_close(mixer);
-            return EXIT_FAILURE;
+            return -1;
+        }
+        if (transaction) {
+            ret = tinymix_stage_value(mixer, transaction, argv[1],
+                                      &argv[2], argc - 2);
+            return ret < 0 ? -1 : !ret;
+        }
+        return tinymix_set_value(mixer, argv[1], &argv[2], argc - 2);
+    }
+
+    if (strcmp(cmd, "get") == 0) {
+        if (argc < 2) {
+            fprintf(stderr, "no control specified\n");
+            return -1;
         }
-        tinymix_set_value(mixer, argv[optind + 1], &argv[optind + 2], argc - optind - 2);
+        return tinymix_detail_control(mixer, argv[1]);
     } else if (strcmp(cmd, "controls") == 0) {
-        tinymix_list_controls(mixer, 0);
+        tinymix_list_controls(mixer, 0, argc > 1 ? argv[1] : NULL);
     } else if (strcmp(cmd, "contents") == 0) {
-        tinymix_list_controls(mixer, 1);
+        tinymix_list_controls(mixer, 1, argc > 1 ? argv[1] : NULL);
+    } else if (strcmp(cmd, "monitor") == 0) {
+        return tinymix_monitor(mixer, &argv[1], argc - 1);
     } else {
         fprintf(stderr, "unknown command '%s' (see --help)\n", cmd);
-        mixer_close(mixer);
-        return EXIT_FAILURE;
+        return -1;
     }
 
-    mixer_close(mixer);
-    return EXIT_SUCCESS;
+    return 0;
+}
+
+/* Splits a script line into arguments, in place. Arguments are separated by
+ * white space and may be enclosed in double quotes. A '#' that starts an
+ * argument starts a comment. Returns the number of arguments.
+ */
+static int tinymix_split_line(char *line, char **args, int max_args)
+{
+    int count = 0;
+    char *p = line;
+
+    while (count < max_args) {
+        while (isspace((unsigned char) *p))
+            p++;
+        if (*p == '\0' || *p == '#')
+            break;
+
+        if (*p == '"') {
+            args[count++] = ++p;
+            while (*p && *p != '"')
+                p++;
+        } else {
+            args[count++] = p;
+            while (*p && !isspace((unsigned char) *p))
+                p++;
+        }
+
+        if (*p == '\0')
+            break;
+        *p++ = '\0';
+    }
+
+    return count;
+}
+
+/* Writes the values staged by the set commands of lines first to last.
+ * Returns 0 on success, -1 on failure.
+ */
+static int tinymix_commit_script(struct mixer_transaction *transaction,
+                                 const char *name, unsigned int first,
+                                 unsigned int last)
+{
+    if (mixer_transaction_commit(transaction) < 0) {
+        fprintf(stderr, "%s:%u-%u: failed to write staged values\n",
+                name, first, last);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Runs the commands of a script against one mixer handle. Consecutive set
+ * commands are written in a single transaction, so every control is
+ * written once with one ioctl. A failing command is reported with its line
+ * number and does not stop the script.
+ * Returns 0 if all commands succeeded, -1 otherwise.
+ */
+static int tinymix_run_script(struct mixer *mixer, const char *filename)
+{
+    struct mixer_transaction *transaction;
+    char line[SCRIPT_LINE_MAX];
+    char *args[SCRIPT_ARGS_MAX];
+    const char *name = filename;
+    unsigned int line_number = 0;
+    unsigned int first_staged = 0;
+    unsigned int last_staged = 0;
+    unsigned int commands = 0;
+    unsigned int failed = 0;
+    FILE *file;
+    int argc;
+    int ret;
+    int c;
+
+    if (!strcmp(filename, "-")) {
+        file = stdin;
+        name = "<stdin>";
+    } else {
+        file = fopen(filename, "r");
+        if (!file) {
+            fprintf(stderr, "Unable to open script file '%s'\n", filename);
+            return -1;
+        }
+    }
+
+    transaction = mixer_transaction_begin(mixer);
+    if (!transaction) {
+        fprintf(stderr, "Failed to begin a transaction\n");
+        if (file != stdin)
+            fclose(file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+
+        /* a line that does not fit is skipped rather than run in pieces */
+        if (!strchr(line, '\n') && (c = fgetc(file)) != EOF) {
+            fprintf(stderr, "%s:%u: line longer than %d characters\n",
+                    name, line_number, SCRIPT_LINE_MAX - 2);
+            while (c != '\n' && (c = fgetc(file)) != EOF)
+                ;
+            commands++;
+            failed++;
+            continue;
+        }
+
+        argc = tinymix_split_line(line, args, SCRIPT_ARGS_MAX);
+        if (argc == 0)
+            continue;
+
+        /* everything but a set observes the values staged so far */
+        if (first_staged && strcmp(args[0], "set") != 0) {
+            if (tinymix_commit_script(transaction, name, first_staged,
+                                      last_staged) < 0)
+                failed++;
+            first_staged = 0;
+        }
+
+        commands++;
+        ret = tinymix_run_command(mixer, transaction, argc, args);
+        if (ret > 0) {
+            /* a set that cannot be staged is written after the ones before it */
+            if (first_staged && tinymix_commit_script(transaction, name,
+                                                      first_staged,
+                                                      last_staged) < 0)
+                failed++;
+            first_staged = 0;
+            ret = tinymix_run_command(mixer, NULL, argc, args);
+        } else if (ret == 0 && !strcmp(args[0], "set")) {
+            if (!first_staged)
+                first_staged = line_number;
+            last_staged = line_number;
+        }
+        if (ret != 0) {
+            fprintf(stderr, "%s:%u: command failed\n", name, line_number);
+            failed++;
+        }
+    }
+
+    if (first_staged && tinymix_commit_script(transaction, name, first_staged,
+                                              last_staged) < 0)
+        failed++;
+
+    mixer_transaction_free(transaction);
+    if (file != stdin)
+        fclose(file);
+
+    if (failed) {
+        fprintf(stderr, "%u of %u commands failed\n", failed, commands);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* The state of a listing of the controls that match a pattern. */
+struct tinymix_listing {
+    int print_all;
+    unsigned int count;
+};
+
+static int tinymix_list_match(struct mixer_ctl *ctl, void *data)
+{
+    struct tinymix_listing *listing = data;
+
+    if (output_format == TINYMIX_FORMAT_JSON)
+        printf("%s\n  ", listing->count ? "," : "");
+    tinymix_print_ctl(ctl, mixer_ctl_get_id(ctl), listing->print_all, 1);
+    listing->count++;
+    return 0;
 }
 
-static void tinymix_list_controls(struct mixer *mixer, int print_all)
+static void tinymix_list_controls(struct mixer *mixer, int print_all,
+                                  const char *pattern)
 {
+    struct tinymix_listing listing = { print_all, 0 };
     struct mixer_ctl *ctl;
-    const char *name, *type;
-    unsigned int num_ctls, num_values;
+    unsigned int num_ctls;
     unsigned int i;
 
     num_ctls = mixer_get_num_ctls(mixer);
 
-    printf("Number of controls: %u\n", num_ctls);
+    switch (output_format) {
+    case TINYMIX_FORMAT_JSON:
+        printf("[");
+        break;
+    case TINYMIX_FORMAT_TSV:
+        printf(print_all ? "ctl\ttype\tnum\tname\tvalue\n" : "ctl\ttype\tnum\tname\n");
+        break;
+    default:
+        if (!pattern)
+            printf("Number of controls: %u\n", num_ctls);
+        if (print_all)
+            printf("ctl\ttype\tnum\t%-40svalue\n", "name");
+        else
+            printf("ctl\ttype\tnum\t%-40s\n", "name");
+        break;
+    }
 
-    if (print_all)
-        printf("ctl\ttype\tnum\t%-40svalue\n", "name");
-    else
-        printf("ctl\ttype\tnum\t%-40s\n", "name");
+    if (pattern) {
+        if (mixer_find_ctls(mixer, pattern, tinymix_list_match, &listing) < 0)
+            fprintf(stderr, "Failed to find the controls matching '%s'\n",
+                    pattern);
+        num_ctls = 0;
+    }
 
+    /* controls are visited by index, so each one is found in constant time
+     * and its values are read once */
     for (i = 0; i < num_ctls; i++) {
         ctl = mixer_get_ctl(mixer, i);
+        if (output_format == TINYMIX_FORMAT_JSON)
+            printf("%s\n  ", i ? "," : "");
+        tinymix_print_ctl(ctl, i, print_all, 1);
+    }
 
-        name = mixer_ctl_get_name(ctl);
-        type = mixer_ctl_get_type_string(ctl);
-        num_values = mixer_ctl_get_num_values(ctl);
-        printf("%u\t%s\t%u\t%-40s", i, type, num_values, name);
-        if (print_all)
-            tinymix_detail_control(mixer, name);
-        printf("\n");
+    if (output_format == TINYMIX_FORMAT_JSON)
+        printf("\n]\n");
+}
+
+static int tinymix_read_values(struct mixer_ctl *ctl,
+                               struct tinymix_values *values)
+{
+    unsigned int tlv_header_size = 0;
+    int ret = 0;
+
+    memset(values, 0, sizeof(*values));
+    values->type = mixer_ctl_get_type(ctl);
+    values->count = mixer_ctl_get_num_values(ctl);
+
+    if (values->count == 0)
+        return 0;
+
+    switch (values->type) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+    case MIXER_CTL_TYPE_ENUM:
+        values->ints = calloc(values->count, sizeof(int));
+        if (!values->ints)
+            goto fail_alloc;
+        ret = mixer_ctl_get_values(ctl, values->ints, values->count);
+        break;
+    case MIXER_CTL_TYPE_INT64:
+        values->ints64 = calloc(values->count, sizeof(long long));
+        if (!values->ints64)
+            goto fail_alloc;
+        ret = mixer_ctl_get_array(ctl, values->ints64, values->count);
+        break;
+    case MIXER_CTL_TYPE_BYTE:
+        if (mixer_ctl_is_access_tlv_rw(ctl) != 0) {
+            tlv_header_size = TLV_HEADER_SIZE;
+        }
+        values->bytes = calloc(1, values->count + tlv_header_size);
+        if (!values->bytes)
+            goto fail_alloc;
+        ret = mixer_ctl_get_array(ctl, values->bytes,
+                                  values->count + tlv_header_size);
+        /* skip the TLV header if it exists */
+        memmove(values->bytes, values->bytes + tlv_header_size, values->count);
+        break;
+    case MIXER_CTL_TYPE_IEC958:
+        ret = mixer_ctl_get_iec958(ctl, &values->iec958);
+        break;
+    default:
+        break;
+    }
+
+    if (ret < 0) {
+        fprintf(stderr, "Failed to read the values of '%s'\n",
+                mixer_ctl_get_name(ctl));
+        tinymix_free_values(values);
+        return -1;
+    }
+
+    return 0;
+
+fail_alloc:
+    fprintf(stderr, "Failed to alloc mem for %u values\n", values->count);
+    return -1;
+}
+
+static void tinymix_free_values(struct tinymix_values *values)
+{
+    free(values->ints);
+    free(values->ints64);
+    free(values->bytes);
+    values->ints = NULL;
+    values->ints64 = NULL;
+    values->bytes = NULL;
+    values->count = 0;
+}
+
+static void tinymix_print_json_string(const char *string)
+{
+    const unsigned char *p;
+
+    putchar('"');
+    for (p = (const unsigned char *) string; *p; p++) {
+        if (*p == '"' || *p == '\\')
+            printf("\\%c", *p);
+        else if (*p < 0x20)
+            printf("\\u%04x", *p);
+        else
+            putchar(*p);
     }
+    putchar('"');
 }
 
-static void tinymix_print_enum(struct mixer_ctl *ctl)
+static void tinymix_print_enum(struct mixer_ctl *ctl, int value)
 {
     unsigned int num_enums;
     unsigned int i;
-    unsigned int value;
     const char *string;
 
     num_enums = mixer_ctl_get_num_enums(ctl);
-    value = mixer_ctl_get_value(ctl, 0);
 
     for (i = 0; i < num_enums; i++) {
         string = mixer_ctl_get_enum_string(ctl, i);
-        printf("%s%s, ", value == i ? "> " : "", string);
+        printf("%s%s, ", (unsigned int) value == i ? "> " : "", string);
     }
 }
 
-static void tinymix_detail_control(struct mixer *mixer, const char *control)
+/* Prints a single value in the JSON and TSV formats. */
+static void tinymix_print_value(struct mixer_ctl *ctl,
+                                const struct tinymix_values *values,
+                                unsigned int i)
 {
-    struct mixer_ctl *ctl;
-    enum mixer_ctl_type type;
-    unsigned int num_values;
+    const char *string;
+
+    switch (values->type) {
+    case MIXER_CTL_TYPE_INT:
+        printf("%d", values->ints[i]);
+        break;
+    case MIXER_CTL_TYPE_BOOL:
+        if (output_format == TINYMIX_FORMAT_JSON)
+            printf("%s", values->ints[i] ? "true" : "false");
+        else
+            printf("%s", values->ints[i] ? "On" : "Off");
+        break;
+    case MIXER_CTL_TYPE_ENUM:
+        string = mixer_ctl_get_enum_string(ctl, values->ints[i]);
+        if (!string)
+            printf("%d", values->ints[i]);
+        else if (output_format == TINYMIX_FORMAT_JSON)
+            tinymix_print_json_string(string);
+        else
+            printf("%s", string);
+        break;
+    case MIXER_CTL_TYPE_BYTE:
+        printf("%u", (unsigned int) values->bytes[i]);
+        break;
+    case MIXER_CTL_TYPE_INT64:
+        printf("%lld", values->ints64[i]);
+        break;
+    default:
+        printf(output_format == TINYMIX_FORMAT_JSON ? "null" : "unknown");
+        break;
+    }
+}
+
+static void tinymix_print_json(struct mixer_ctl *ctl, unsigned int id,
+                               int print_values,
+                               const struct tinymix_values *values)
+{
+    enum mixer_ctl_type type = mixer_ctl_get_type(ctl);
+    unsigned int num_enums;
     unsigned int i;
-    int min, max;
-    int ret;
-    char *buf = NULL;
-    unsigned int tlv_header_size = 0;
 
-    if (isdigit(control[0]))
-        ctl = mixer_get_ctl(mixer, atoi(control));
-    else
-        ctl = mixer_get_ctl_by_name(mixer, control);
+    printf("{\"ctl\": %u, \"type\": \"%s\", \"num\": %u, \"name\": ", id,
+           mixer_ctl_get_type_string(ctl), mixer_ctl_get_num_values(ctl));
+    tinymix_print_json_string(mixer_ctl_get_name(ctl));
 
-    if (!ctl) {
-        fprintf(stderr, "Invalid mixer control\n");
+    if (!print_values) {
+        printf("}");
         return;
     }
 
-    type = mixer_ctl_get_type(ctl);
-    num_values = mixer_ctl_get_num_values(ctl);
-
-    if ((type == MIXER_CTL_TYPE_BYTE) && (num_values > 0)) {
-        if (mixer_ctl_is_access_tlv_rw(ctl) != 0) {
-            tlv_header_size = TLV_HEADER_SIZE;
-        }
-        buf = calloc(1, num_values + tlv_header_size);
-        if (buf == NULL) {
-            fprintf(stderr, "Failed to alloc mem for bytes %u\n", num_values);
-            return;
+    printf(", \"values\": ");
+    if (!values) {
+        printf("null");
+    } else if (type == MIXER_CTL_TYPE_IEC958) {
+        printf("{\"status\": [");
+        for (i = 0; i < sizeof(values->iec958.status); i++)
+            printf("%s%u", i ? ", " : "", values->iec958.status[i]);
+        printf("]}");
+    } else {
+        printf("[");
+        for (i = 0; i < values->count; i++) {
+            printf("%s", i ? ", " : "");
+            tinymix_print_value(ctl, values, i);
         }
+        printf("]");
+    }
 
-        ret = mixer_ctl_get_array(ctl, buf, num_values + tlv_header_size);
-        if (ret < 0) {
-            fprintf(stderr, "Failed to mixer_ctl_get_array\n");
-            free(buf);
-            return;
+    if (type == MIXER_CTL_TYPE_INT) {
+        printf(", \"min\": %d, \"max\": %d", mixer_ctl_get_range_min(ctl),
+               mixer_ctl_get_range_max(ctl));
+    } else if (type == MIXER_CTL_TYPE_ENUM) {
+        num_enums = mixer_ctl_get_num_enums(ctl);
+        printf(", \"enums\": [");
+        for (i = 0; i < num_enums; i++) {
+            printf("%s", i ? ", " : "");
+            tinymix_print_json_string(mixer_ctl_get_enum_string(ctl, i));
         }
+        printf("]");
     }
 
-    for (i = 0; i < num_values; i++) {
-        switch (type)
+    printf("}");
+}
+
+static void tinymix_print_plain(struct mixer_ctl *ctl,
+                                const struct tinymix_values *values)
+{
+    unsigned int i;
+
+    for (i = 0; i < values->count; i++) {
+        switch (values->type)
         {
         case MIXER_CTL_TYPE_INT:
-            printf("%d", mixer_ctl_get_value(ctl, i));
+            printf("%d", values->ints[i]);
             break;
         case MIXER_CTL_TYPE_BOOL:
-            printf("%s", mixer_ctl_get_value(ctl, i) ? "On" : "Off");
+            printf("%s", values->ints[i] ? "On" : "Off");
             break;
         case MIXER_CTL_TYPE_ENUM:
-            tinymix_print_enum(ctl);
+            tinymix_print_enum(ctl, values->ints[i]);
             break;
         case MIXER_CTL_TYPE_BYTE:
-            /* skip printing TLV header if exists */
-            printf(" %02x", buf[i + tlv_header_size]);
+            printf(" %02x", values->bytes[i]);
+            break;
+        case MIXER_CTL_TYPE_INT64:
+            printf("%lld", values->ints64[i]);
             break;
         default:
             printf("unknown");
             break;
         };
-        if ((i + 1) < num_values) {
+        if ((i + 1) < values->count) {
            printf(", ");
         }
     }
 
-    if (type == MIXER_CTL_TYPE_INT) {
-        min = mixer_ctl_get_range_min(ctl);
-        max = mixer_ctl_get_range_max(ctl);
-        printf(" (range %d->%d)", min, max);
+    if (values->type == MIXER_CTL_TYPE_INT) {
+        printf(" (range %d->%d)", mixer_ctl_get_range_min(ctl),
+               mixer_ctl_get_range_max(ctl));
     }
+}
 
-    free(buf);
+/* Prints a control in the output format. With a header, the id, type and
+ * name of the control precede its values.
+ * Returns 0 on success, -1 if the values could not be read.
+ */
+static int tinymix_print_ctl(struct mixer_ctl *ctl, unsigned int id,
+                             int print_values, int print_header)
+{
+    struct tinymix_values values;
+    unsigned int i;
+    int ret = 0;
+
+    if (print_values)
+        ret = tinymix_read_values(ctl, &values);
+
+    switch (output_format) {
+    case TINYMIX_FORMAT_JSON:
+        tinymix_print_json(ctl, id, print_values, ret == 0 ? &values : NULL);
+        break;
+    case TINYMIX_FORMAT_TSV:
+        if (print_header)
+            printf("%u\t%s\t%u\t%s", id, mixer_ctl_get_type_string(ctl),
+                   mixer_ctl_get_num_values(ctl), mixer_ctl_get_name(ctl));
+        if (print_values && ret == 0) {
+            printf("%s", print_header ? "\t" : "");
+            for (i = 0; i < values.count; i++) {
+                printf("%s", i ? "," : "");
+                tinymix_print_value(ctl, &values, i);
+            }
+        }
+        break;
+    default:
+        if (print_header)
+            printf("%u\t%s\t%u\t%-40s", id, mixer_ctl_get_type_string(ctl),
+                   mixer_ctl_get_num_values(ctl), mixer_ctl_get_name(ctl));
+        if (print_values && ret == 0)
+            tinymix_print_plain(ctl, &values);
+        break;
+    }
+
+    /* JSON objects are separated by the caller */
+    if (output_format != TINYMIX_FORMAT_JSON)
+        printf("\n");
+
+    if (print_values && ret == 0)
+        tinymix_free_values(&values);
+
+    return ret;
+}
+
+static int tinymix_detail_control(struct mixer *mixer, const char *control)
+{
+    struct mixer_ctl *ctl;
+    int ret;
+
+    ctl = tinymix_get_ctl(mixer, control);
+    if (!ctl) {
+        fprintf(stderr, "Invalid mixer control\n");
+        return -1;
+    }
+
+    if (output_format == TINYMIX_FORMAT_JSON) {
+        ret = tinymix_print_ctl(ctl, mixer_ctl_get_id(ctl), 1, 1);
+        printf("\n");
+        return ret;
+    }
+
+    return tinymix_print_ctl(ctl, mixer_ctl_get_id(ctl), 1, 0);
+}
+
+static int tinymix_values_equal(const struct tinymix_values *a,
+                                const struct tinymix_values *b)
+{
+    if (a->type != b->type || a->count != b->count)
+        return 0;
+
+    if (a->ints)
+        return !memcmp(a->ints, b->ints, a->count * sizeof(*a->ints));
+    if (a->ints64)
+        return !memcmp(a->ints64, b->ints64, a->count * sizeof(*a->ints64));
+    if (a->bytes)
+        return !memcmp(a->bytes, b->bytes, a->count);
+
+    return !memcmp(&a->iec958, &b->iec958, sizeof(a->iec958));
+}
+
+static void tinymix_print_value_list(struct mixer_ctl *ctl,
+                                     const struct tinymix_values *values,
+                                     const char *separator)
+{
+    unsigned int i;
+
+    for (i = 0; i < values->count; i++) {
+        printf("%s", i ? separator : "");
+        tinymix_print_value(ctl, values, i);
+    }
+}
+
+static void tinymix_monitor_watch(struct tinymix_monitor *monitor,
+                                  unsigned int id)
+{
+    struct mixer_ctl *ctl = mixer_get_ctl(monitor->mixer, id);
+
+    monitor->flags[id] |= MONITOR_WATCHED;
+    if (tinymix_read_values(ctl, &monitor->values[id]) < 0)
+        memset(&monitor->values[id], 0, sizeof(monitor->values[id]));
+}
+
+/* Makes room for the controls added since the monitor last looked and
+ * reads their initial values. Returns the new number of controls.
+ */
+static unsigned int tinymix_monitor_grow(struct tinymix_monitor *monitor)
+{
+    struct tinymix_values *values;
+    unsigned int *pending_ids;
+    unsigned char *flags;
+    unsigned int num_ctls;
+    unsigned int i;
+
+    num_ctls = mixer_get_num_ctls(monitor->mixer);
+    if (num_ctls <= monitor->num_ctls)
+        return monitor->num_ctls;
+
+    values = realloc(monitor->values, num_ctls * sizeof(*values));
+    if (!values)
+        return monitor->num_ctls;
+    monitor->values = values;
+
+    pending_ids = realloc(monitor->pending_ids, num_ctls * sizeof(*pending_ids));
+    if (!pending_ids)
+        return monitor->num_ctls;
+    monitor->pending_ids = pending_ids;
+
+    flags = realloc(monitor->flags, num_ctls);
+    if (!flags)
+        return monitor->num_ctls;
+    monitor->flags = flags;
+
+    for (i = monitor->num_ctls; i < num_ctls; i++) {
+        memset(&values[i], 0, sizeof(values[i]));
+        /* controls added later are only watched if all controls are */
+        flags[i] = 0;
+        if (monitor->watch_all)
+            tinymix_monitor_watch(monitor, i);
+    }
+
+    monitor->num_ctls = num_ctls;
+    return num_ctls;
+}
+
+static void tinymix_monitor_print(struct tinymix_monitor *monitor,
+                                  const struct timespec *now, unsigned int id,
+                                  const char *event,
+                                  const struct tinymix_values *old_values)
+{
+    struct mixer_ctl *ctl = mixer_get_ctl(monitor->mixer, id);
+    const struct tinymix_values *values = &monitor->values[id];
+    unsigned int i;
+
+    switch (output_format) {
+    case TINYMIX_FORMAT_JSON:
+        printf("{\"time\": %ld.%06ld, \"ctl\": %u, \"event\": \"%s\", \"name\": ",
+               (long) now->tv_sec, now->tv_nsec / 1000, id, event);
+        tinymix_print_json_string(mixer_ctl_get_name(ctl));
+        printf(", \"values\": [");
+        tinymix_print_value_list(ctl, values, ", ");
+        printf("]");
+        if (old_values) {
+            printf(", \"previous\": [");
+            tinymix_print_value_list(ctl, old_values, ", ");
+            printf("]");
+        }
+        printf("}\n");
+        break;
+    case TINYMIX_FORMAT_TSV:
+        printf("%ld.%06ld\t%u\t%s\t%s\t", (long) now->tv_sec,
+               now->tv_nsec / 1000, id, event, mixer_ctl_get_name(ctl));
+        tinymix_print_value_list(ctl, values, ",");
+        printf("\n");
+        break;
+    default:
+        printf("[%5ld.%06ld] %u %s %s:", (long) now->tv_sec,
+               now->tv_nsec / 1000, id, event, mixer_ctl_get_name(ctl));
+        if (!old_values || old_values->count != values->count) {
+            printf(" ");
+            tinymix_print_value_list(ctl, values, ", ");
+        } else {
+            /* only print the values that changed */
+            for (i = 0; i < values->count; i++) {
+                if (values->ints && values->ints[i] == old_values->ints[i])
+                    continue;
+                if (values->ints64 && values->ints64[i] == old_values->ints64[i])
+                    continue;
+                if (values->bytes && values->bytes[i] == old_values->bytes[i])
+                    continue;
+                printf(" [%u] ", i);
+                tinymix_print_value(ctl, old_values, i);
+                printf(" -> ");
+                tinymix_print_value(ctl, values, i);
+            }
+        }
+        printf("\n");
+        break;
+    }
+}
+
+/* Re-reads the controls that had events since the last batch and prints
+ * the ones whose values changed. Each control is read once per batch, no
+ * matter how many events it had.
+ */
+static void tinymix_monitor_flush(struct tinymix_monitor *monitor)
+{
+    struct tinymix_values old_values;
+    struct mixer_ctl *ctl;
+    struct timespec now;
+    unsigned int id;
+    unsigned int n;
+    unsigned char flags;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (n = 0; n < monitor->num_pending; n++) {
+        id = monitor->pending_ids[n];
+        flags = monitor->flags[id];
+        monitor->flags[id] &= ~(MONITOR_PENDING | MONITOR_REMOVED);
+        ctl = mixer_get_ctl(monitor->mixer, id);
+
+        if (flags & MONITOR_REMOVED) {
+            tinymix_free_values(&monitor->values[id]);
+            tinymix_monitor_print(monitor, &now, id, "removed", NULL);
+            continue;
+        }
+
+        old_values = monitor->values[id];
+        if (tinymix_read_values(ctl, &monitor->values[id]) < 0) {
+            monitor->values[id] = old_values;
+            continue;
+        }
+
+        if (old_values.count == 0) {
+            tinymix_monitor_print(monitor, &now, id, "added", NULL);
+        } else if (!tinymix_values_equal(&old_values, &monitor->values[id])) {
+            tinymix_monitor_print(monitor, &now, id, "changed", &old_values);
+        }
+        tinymix_free_values(&old_values);
+    }
+
+    monitor->num_pending = 0;
+    fflush(stdout);
+}
+
+/* Prints the changes of the given controls, or all controls, as they
+ * happen. Events are read in batches and coalesced, so a control that
+ * changes many times while the monitor is busy is read only once.
+ * Returns -1 if the events can not be read, it does not return otherwise.
+ */
+static int tinymix_monitor(struct mixer *mixer, char **controls,
+                           unsigned int num_controls)
+{
+    struct tinymix_monitor monitor;
+    struct mixer_ctl_event events[MONITOR_EVENTS_MAX];
+    const struct mixer_ctl_event *event;
+    struct mixer_ctl *ctl;
+    unsigned int i;
+    int count;
+    int ret = -1;
+
+    memset(&monitor, 0, sizeof(monitor));
+    monitor.mixer = mixer;
+    monitor.watch_all = num_controls == 0;
+
+    if (tinymix_monitor_grow(&monitor) != mixer_get_num_ctls(mixer)) {
+        fprintf(stderr, "Failed to alloc mem for %u controls\n",
+                mixer_get_num_ctls(mixer));
+        goto done;
+    }
+
+    for (i = 0; i < num_controls; i++) {
+        ctl = tinymix_get_ctl(mixer, controls[i]);
+        if (!ctl) {
+            fprintf(stderr, "Invalid mixer control '%s'\n", controls[i]);
+            goto done;
+        }
+        tinymix_monitor_watch(&monitor, mixer_ctl_get_id(ctl));
+    }
+
+    if (mixer_subscribe_events(mixer, 1) < 0) {
+        fprintf(stderr, "Failed to subscribe to mixer events\n");
+        goto done;
+    }
+
+    for (;;) {
+        count = mixer_wait_event(mixer, -1);
+        if (count < 0 && count != -EINTR) {
+            fprintf(stderr, "Failed to wait for mixer events\n");
+            break;
+        }
+        if (count <= 0)
+            continue;
+
+        count = mixer_read_event(mixer, events, MONITOR_EVENTS_MAX);
+        if (count < 0) {
+            fprintf(stderr, "Failed to read mixer events\n");
+            break;
+        }
+
+        for (event = events; event < &events[count]; event++) {
+            if (event->id >= monitor.num_ctls) {
+                if (!(event->mask & MIXER_CTL_EVENT_ADD))
+                    continue;
+                mixer_add_new_ctls(mixer);
+                if (event->id >= tinymix_monitor_grow(&monitor))
+                    continue;
+            }
+
+            if (!(monitor.flags[event->id] & MONITOR_WATCHED))
+                continue;
+
+            if (event->mask & MIXER_CTL_EVENT_REMOVE)
+                monitor.flags[event->id] |= MONITOR_REMOVED;
+            else if (event->mask & MIXER_CTL_EVENT_INFO)
+                mixer_ctl_update(mixer_get_ctl(mixer, event->id));
+
+            if (!(monitor.flags[event->id] & MONITOR_PENDING)) {
+                monitor.flags[event->id] |= MONITOR_PENDING;
+                monitor.pending_ids[monitor.num_pending++] = event->id;
+            }
+        }
+
+        /* keep batching while the driver has more events queued */
+        if (count == MONITOR_EVENTS_MAX && mixer_wait_event(mixer, 0) > 0)
+            continue;
+
+        tinymix_monitor_flush(&monitor);
+    }
+
+    mixer_subscribe_events(mixer, 0);
+
+done:
+    for (i = 0; i < monitor.num_ctls; i++)
+        tinymix_free_values(&monitor.values[i]);
+    free(monitor.values);
+    free(monitor.pending_ids);
+    free(monitor.flags);
+    return ret;
 }
 
-static void tinymix_set_byte_ctl(struct mixer_ctl *ctl,
-                                 char **values, unsigned int num_values)
+static int tinymix_set_byte_ctl(struct mixer_ctl *ctl,
+                                char **values, unsigned int num_values)
 {
     int ret;
     char *buf;
@@ -285,7 +1074,7 @@ static void tinymix_set_byte_ctl(struct mixer_ctl *ctl,
     buf = calloc(1, tlv_size);
     if (buf == NULL) {
         fprintf(stderr, "set_byte_ctl: Failed to alloc mem for bytes %u\n", num_values);
-        exit(EXIT_FAILURE);
+        return -1;
     }
 
     tlv = (unsigned int *)buf;
@@ -320,11 +1109,11 @@ static void tinymix_set_byte_ctl(struct mixer_ctl *ctl,
     }
 
     free(buf);
-    return;
+    return 0;
 
 fail:
     free(buf);
-    exit(EXIT_FAILURE);
+    return -1;
 }
 
 static int is_int(char *value)
@@ -341,69 +1130,164 @@ static int is_int(char *value)
     return errno == 0 && *end == '\0';
 }
 
-static void tinymix_set_value(struct mixer *mixer, const char *control,
-                              char **values, unsigned int num_values)
+/* Checks the values of a set command on an integer, boolean or enumerated
+ * control and stages them in the transaction.
+ * Returns 1 if the values were staged, 0 if the command has to be run on its
+ * own (other control types), -1 on error.
+ */
+static int tinymix_stage_value(struct mixer *mixer,
+                               struct mixer_transaction *transaction,
+                               const char *control, char **values,
+                               unsigned int num_values)
 {
     struct mixer_ctl *ctl;
     enum mixer_ctl_type type;
     unsigned int num_ctl_values;
+    unsigned int num_enums;
     unsigned int i;
+    int min = INT_MIN;
+    int max = INT_MAX;
+    int value;
 
-    if (isdigit(control[0]))
-        ctl = mixer_get_ctl(mixer, atoi(control));
-    else
-        ctl = mixer_get_ctl_by_name(mixer, control);
-
+    ctl = tinymix_get_ctl(mixer, control);
     if (!ctl) {
         fprintf(stderr, "Invalid mixer control\n");
-        return;
+        return -1;
     }
 
     type = mixer_ctl_get_type(ctl);
     num_ctl_values = mixer_ctl_get_num_values(ctl);
 
-    if (type == MIXER_CTL_TYPE_BYTE) {
-        tinymix_set_byte_ctl(ctl, values, num_values);
-        return;
+    if (type == MIXER_CTL_TYPE_ENUM && num_values == 1 && !is_int(values[0])) {
+        num_enums = mixer_ctl_get_num_enums(ctl);
+        for (i = 0; i < num_enums; i++) {
+            const char *string = mixer_ctl_get_enum_string(ctl, i);
+            if (string && !strcmp(string, values[0]))
+                break;
+        }
+        if (i == num_enums) {
+            fprintf(stderr, "Error: invalid enum value\n");
+            return -1;
+        }
+        return mixer_transaction_set_value(transaction, ctl, 0, i) < 0 ? -1 : 1;
+    }
+
+    if (type == MIXER_CTL_TYPE_INT) {
+        min = mixer_ctl_get_range_min(ctl);
+        max = mixer_ctl_get_range_max(ctl);
+    } else if (type == MIXER_CTL_TYPE_ENUM) {
+        min = 0;
+        max = mixer_ctl_get_num_enums(ctl) - 1;
+    } else if (type != MIXER_CTL_TYPE_BOOL) {
+        return 0;
+    }
+
+    if (num_values > num_ctl_values) {
+        fprintf(stderr,
+                "Error: %u values given, but control only takes %u\n",
+                num_values, num_ctl_values);
+        return -1;
+    }
+
+    /* check all values first, so that a bad command stages nothing */
+    for (i = 0; i < num_values; i++) {
+        if (!is_int(values[i])) {
+            if (type == MIXER_CTL_TYPE_ENUM)
+                fprintf(stderr, "Enclose strings in quotes and try again\n");
+            else
+                fprintf(stderr, "Error: only enum types can be set with strings\n");
+            return -1;
+        }
+        value = atoi(values[i]);
+        if (value < min || value > max) {
+            fprintf(stderr, "Error: invalid value\n");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < num_ctl_values && (num_values == 1 || i < num_values); i++) {
+        value = atoi(values[num_values == 1 ? 0 : i]);
+        if (mixer_transaction_set_value(transaction, ctl, i, value) < 0) {
+            fprintf(stderr, "Error: invalid value\n");
+            return -1;
+        }
+    }
+
+    return 1;
+}
+
+static int tinymix_set_value(struct mixer *mixer, const char *control,
+                             char **values, unsigned int num_values)
+{
+    struct mixer_ctl *ctl;
+    enum mixer_ctl_type type;
+    unsigned int num_ctl_values;
+    unsigned int i;
+
+    ctl = tinymix_get_ctl(mixer, control);
+    if (!ctl) {
+        fprintf(stderr, "Invalid mixer control\n");
+        return -1;
     }
 
+    type = mixer_ctl_get_type(ctl);
+    num_ctl_values = mixer_ctl_get_num_values(ctl);
+
+    if (type == MIXER_CTL_TYPE_BYTE)
+        return tinymix_set_byte_ctl(ctl, values, num_values);
+
     if (is_int(values[0])) {
+        int *int_values;
+        int ret = 0;
+
+        if (num_values > num_ctl_values) {
+            fprintf(stderr,
+                    "Error: %u values given, but control only takes %u\n",
+                    num_values, num_ctl_values);
+            return -1;
+        }
+
+        int_values = calloc(num_ctl_values, sizeof(int));
+        if (int_values == NULL) {
+            fprintf(stderr, "Failed to alloc mem for %u values\n", num_ctl_values);
+            return -1;
+        }
+
         if (num_values == 1) {
             /* Set all values the same */
-            int value = atoi(values[0]);
-
-            for (i = 0; i < num_ctl_values; i++) {
-                if (mixer_ctl_set_value(ctl, i, value)) {
-                    fprintf(stderr, "Error: invalid value\n");
-                    return;
-                }
-            }
+            for (i = 0; i < num_ctl_values; i++)
+                int_values[i] = atoi(values[0]);
+            num_values = num_ctl_values;
         } else {
             /* Set multiple values */
-            if (num_values > num_ctl_values) {
-                fprintf(stderr,
-                        "Error: %u values given, but control only takes %u\n",
-                        num_values, num_ctl_values);
-                return;
-            }
-            for (i = 0; i < num_values; i++) {
-                if (mixer_ctl_set_value(ctl, i, atoi(values[i]))) {
-                    fprintf(stderr, "Error: invalid value for index %u\n", i);
-                    return;
-                }
-            }
+            for (i = 0; i < num_values; i++)
+                int_values[i] = atoi(values[i]);
         }
+
+        /* all values are written at once */
+        if (mixer_ctl_set_values(ctl, int_values, num_values)) {
+            fprintf(stderr, "Error: invalid value\n");
+            ret = -1;
+        }
+
+        free(int_values);
+        return ret;
     } else {
         if (type == MIXER_CTL_TYPE_ENUM) {
             if (num_values != 1) {
                 fprintf(stderr, "Enclose strings in quotes and try again\n");
-                return;
+                return -1;
             }
-            if (mixer_ctl_set_enum_by_string(ctl, values[0]))
+            if (mixer_ctl_set_enum_by_string(ctl, values[0])) {
                 fprintf(stderr, "Error: invalid enum value\n");
+                return -1;
+            }
         } else {
             fprintf(stderr, "Error: only enum types can be set with strings\n");
+            return -1;
         }
     }
+
+    return 0;
 }
 
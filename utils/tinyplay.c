@@ -32,6 +32,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 struct cmd {
     const char *filename;
@@ -176,12 +181,68 @@ struct ctx {
     struct chunk_fmt chunk_fmt;
 
     FILE *file;
+
+    /* the mapping of the audio data, NULL if the file is not mapped */
+    void *map;
+    size_t map_size;
+    const char *data;
+    size_t data_size;
+    off_t data_offset;
+
+    /* read the audio straight into the DMA buffer of an mmap PCM */
+    int stream_to_mmap;
 };
 
+/* Maps the audio data of a regular file, starting at the current position,
+ * so that it is written to the PCM straight from the page cache.
+ * data_size limits the mapping, unless it is zero.
+ * Returns 0 if the data is mapped, -1 if it has to be read.
+ */
+static int ctx_map_data(struct ctx *ctx, size_t data_size)
+{
+    struct stat st;
+    long page_size = sysconf(_SC_PAGESIZE);
+    int fd = fileno(ctx->file);
+    off_t offset;
+    off_t map_offset;
+    size_t length;
+
+    if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) || (page_size <= 0))
+        return -1;
+
+    offset = ftello(ctx->file);
+    if ((offset < 0) || (offset >= st.st_size))
+        return -1;
+
+    length = st.st_size - offset;
+    if ((data_size > 0) && (data_size < length))
+        length = data_size;
+
+    map_offset = offset & ~((off_t) page_size - 1);
+    ctx->map_size = length + (offset - map_offset);
+    ctx->map = mmap(NULL, ctx->map_size, PROT_READ, MAP_SHARED, fd, map_offset);
+    if (ctx->map == MAP_FAILED) {
+        ctx->map = NULL;
+        return -1;
+    }
+
+    ctx->data = (const char *) ctx->map + (offset - map_offset);
+    ctx->data_size = length;
+    ctx->data_offset = offset;
+
+    /* the data is read once, front to back */
+    madvise(ctx->map, ctx->map_size, MADV_SEQUENTIAL);
+    posix_fadvise(fd, offset, length, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
 int ctx_init(struct ctx* ctx, const struct cmd *cmd)
 {
     unsigned int bits = cmd->bits;
     struct pcm_config config = cmd->config;
+    size_t data_size = 0;
+
+    ctx->map = NULL;
 
     if (cmd->filename == NULL) {
         fprintf(stderr, "filename not specified\n");
@@ -197,6 +258,13 @@ int ctx_init(struct ctx* ctx, const struct cmd *cmd)
         return -1;
     }
 
+    /* the audio may be read from the file descriptor, past stdio, so stdio
+     * must not read ahead of the headers */
+    ctx->stream_to_mmap = (cmd->flags & PCM_MMAP) != 0;
+    if (ctx->stream_to_mmap) {
+        setvbuf(ctx->file, NULL, _IONBF, 0);
+    }
+
     if ((cmd->filetype != NULL) && (strcmp(cmd->filetype, "wav") == 0)) {
         if (fread(&ctx->wave_header, sizeof(ctx->wave_header), 1, ctx->file) != 1){
             fprintf(stderr, "error: '%s' does not contain a riff/wave header\n", cmd->filename);
@@ -239,6 +307,7 @@ int ctx_init(struct ctx* ctx, const struct cmd *cmd)
         config.channels = ctx->chunk_fmt.num_channels;
         config.rate = ctx->chunk_fmt.sample_rate;
         bits = ctx->chunk_fmt.bits_per_sample;
+        data_size = ctx->chunk_header.sz;
     }
 
     if (bits == 8) {
@@ -270,6 +339,9 @@ int ctx_init(struct ctx* ctx, const struct cmd *cmd)
         return -1;
     }
 
+    /* pipes and other files that can not be mapped are read instead */
+    ctx_map_data(ctx, data_size);
+
     return 0;
 }
 
@@ -281,12 +353,15 @@ void ctx_free(struct ctx *ctx)
     if (ctx->pcm != NULL) {
         pcm_close(ctx->pcm);
     }
+    if (ctx->map != NULL) {
+        munmap(ctx->map, ctx->map_size);
+    }
     if (ctx->file != NULL) {
         fclose(ctx->file);
     }
 }
 
-static int close = 0;
+static int closing = 0;
 
 int play_sample(struct ctx *ctx);
 
@@ -294,7 +369,7 @@ void stream_close(int sig)
 {
     /* allow the stream to be closed gracefully */
     signal(sig, SIG_IGN);
-    close = 1;
+    closing = 1;
 }
 
 void print_usage(const char *argv0)
@@ -393,12 +468,175 @@ int sample_is_playable(const struct cmd *cmd)
     return can_play;
 }
 
+/* Plays mapped audio data. The data is passed to the PCM in place, so it is
+ * copied once, from the page cache to the kernel, or to the DMA buffer of a
+ * PCM opened with -M.
+ */
+static int play_mapped_sample(struct ctx *ctx)
+{
+    size_t size;
+    size_t pos = 0;
+    unsigned int frames;
+    int written;
+
+    size = pcm_frames_to_bytes(ctx->pcm, pcm_get_buffer_size(ctx->pcm));
+
+    /* catch ctrl-c to shutdown cleanly */
+    signal(SIGINT, stream_close);
+
+    while (!closing && (pos < ctx->data_size)) {
+        if (size > ctx->data_size - pos)
+            size = ctx->data_size - pos;
+        frames = pcm_bytes_to_frames(ctx->pcm, size);
+        if (frames == 0)
+            break;
+
+        /* start reading the next buffer while this one plays */
+        posix_fadvise(fileno(ctx->file), ctx->data_offset + pos + size, size,
+                      POSIX_FADV_WILLNEED);
+
+        written = pcm_writei(ctx->pcm, ctx->data + pos, frames);
+        if (written < 0) {
+            fprintf(stderr, "error playing sample\n");
+            break;
+        }
+        pos += pcm_frames_to_bytes(ctx->pcm, written);
+    }
+
+    return 0;
+}
+
+/* Plays audio read from a pipe with a PCM opened with -M. The audio is
+ * read() straight into the DMA buffer of the PCM, so it is copied once.
+ */
+static int play_streamed_sample(struct ctx *ctx)
+{
+    int fd = fileno(ctx->file);
+    unsigned int frame_size = pcm_frames_to_bytes(ctx->pcm, 1);
+    unsigned int start_threshold = pcm_get_config(ctx->pcm)->start_threshold;
+    unsigned int buffer_size = pcm_get_buffer_size(ctx->pcm);
+    unsigned int rate = pcm_get_config(ctx->pcm)->rate;
+    unsigned int queued = 0;
+    unsigned int partial = 0;
+    unsigned int offset;
+    unsigned int frames;
+    void *areas;
+    char *window;
+    char *pending = NULL;
+    ssize_t num_read;
+    int avail;
+    int ret;
+
+    if (start_threshold > buffer_size) {
+        start_threshold = buffer_size;
+    }
+
+    /* catch ctrl-c to shutdown cleanly */
+    signal(SIGINT, stream_close);
+
+    while (!closing) {
+        avail = pcm_avail_update(ctx->pcm);
+        if (avail < 0) {
+            fprintf(stderr, "error playing sample\n");
+            return -1;
+        }
+
+        if (avail == 0) {
+            ret = pcm_wait(ctx->pcm, -1);
+            if (ret == -EPIPE) {
+                /* underrun, start over once the buffer is filled again */
+                pcm_prepare(ctx->pcm);
+                queued = 0;
+            } else if (ret < 0 && ret != -EINTR) {
+                fprintf(stderr, "error playing sample\n");
+                return -1;
+            }
+            continue;
+        }
+
+        frames = avail;
+        if (pcm_mmap_begin(ctx->pcm, &areas, &offset, &frames) < 0) {
+            fprintf(stderr, "error playing sample (%s)\n", pcm_get_error(ctx->pcm));
+            return -1;
+        }
+        window = (char *) areas + pcm_frames_to_bytes(ctx->pcm, offset);
+
+        /* a partial frame from the last read goes at the start of the window,
+         * where it normally is already */
+        if (partial > 0 && pending != window) {
+            memmove(window, pending, partial);
+        }
+
+        num_read = read(fd, window + partial,
+                        pcm_frames_to_bytes(ctx->pcm, frames) - partial);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            break;
+        }
+
+        partial += num_read;
+        frames = partial / frame_size;
+        partial -= frames * frame_size;
+        pending = window + frames * frame_size;
+        if (frames == 0) {
+            continue;
+        }
+
+        if (pcm_mmap_commit(ctx->pcm, offset, frames) < 0) {
+            fprintf(stderr, "error playing sample\n");
+            return -1;
+        }
+
+        queued += frames;
+        if (queued >= start_threshold && pcm_state(ctx->pcm) == PCM_STATE_PREPARED) {
+            pcm_start(ctx->pcm);
+        }
+    }
+
+    /* play what is left of a short stream */
+    if (queued > 0 && pcm_state(ctx->pcm) == PCM_STATE_PREPARED) {
+        pcm_start(ctx->pcm);
+    }
+
+    /* closing the PCM drops the queued frames, so wait until they have
+     * played, that is until the whole buffer is free again */
+    while (!closing && queued > 0) {
+        avail = pcm_avail_update(ctx->pcm);
+        if (avail < 0 || (unsigned int) avail >= buffer_size) {
+            break;
+        }
+        ret = pcm_wait(ctx->pcm, -1);
+        if (ret == -EPIPE) {
+            /* the buffer ran empty */
+            break;
+        } else if (ret < 0 && ret != -EINTR) {
+            fprintf(stderr, "error playing sample\n");
+            return -1;
+        }
+        /* pcm_wait() returns once a period is free, sleep for the rest */
+        if (ret > 0) {
+            usleep((unsigned long long) (buffer_size - avail) * 1000000 / rate);
+        }
+    }
+
+    return 0;
+}
+
 int play_sample(struct ctx *ctx)
 {
     char *buffer;
     int size;
     int num_read;
 
+    if (ctx->map != NULL) {
+        return play_mapped_sample(ctx);
+    }
+    if (ctx->stream_to_mmap) {
+        return play_streamed_sample(ctx);
+    }
+
     size = pcm_frames_to_bytes(ctx->pcm, pcm_get_buffer_size(ctx->pcm));
     buffer = malloc(size);
     if (!buffer) {
@@ -418,7 +656,7 @@ int play_sample(struct ctx *ctx)
                 break;
             }
         }
-    } while (!close && num_read > 0);
+    } while (!closing && num_read > 0);
 
     free(buffer);
     return 0;